@@ -0,0 +1,142 @@
+#include <vector>
+#include <benchmark/benchmark.h>
+
+#include "cyclone/body.h"
+#include "cyclone/collide_coarse.h"
+
+using namespace cyclone;
+
+namespace {
+	// Boxes of side 1 to 2 spread in a cube at constant density, so the pair count grows linearly
+	struct BoxScene {
+		std::vector<RigidBody> bodies;
+		std::vector<BoundingBox> boxes;
+		std::vector<Vector3> velocities;
+		unsigned seed;
+
+		BoxScene(unsigned count) : bodies(count), boxes(count), velocities(count), seed(12345) {
+			real side = real_pow((real)count * 8, (real)1 / 3);
+			for (unsigned i = 0; i < count; ++i) {
+				Vector3 centre(random() * side, random() * side, random() * side);
+				real half = (real)0.5 + random() * (real)0.5;
+				boxes[i] = BoundingBox(centre - Vector3(half, half, half), centre + Vector3(half, half, half));
+				velocities[i] = Vector3(random() - (real)0.5, random() - (real)0.5, random() - (real)0.5);
+			}
+		}
+
+		real random() {
+			seed = seed * 1664525u + 1013904223u;
+			return (real)(seed >> 8) / (real)(1 << 24);
+		}
+
+		void build(BoundingBoxTree& tree, std::vector<unsigned>& proxies) {
+			tree.reserve((unsigned)bodies.size());
+			proxies.resize(bodies.size());
+			for (unsigned i = 0; i < bodies.size(); ++i) {
+				proxies[i] = tree.createProxy(boxes[i], &bodies[i]);
+			}
+		}
+	};
+}
+
+static void BM_BoundingBoxTreeBuild(benchmark::State& state) {
+	BoxScene scene((unsigned)state.range(0));
+	std::vector<unsigned> proxies;
+	for (auto _ : state) {
+		BoundingBoxTree tree;
+		scene.build(tree, proxies);
+		benchmark::DoNotOptimize(tree.getHeight());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BoundingBoxTreeBuild)->RangeMultiplier(10)->Range(1000, 100000);
+
+static void BM_BoundingBoxTreeFindPairs(benchmark::State& state) {
+	BoxScene scene((unsigned)state.range(0));
+	BoundingBoxTree tree;
+	std::vector<unsigned> proxies;
+	scene.build(tree, proxies);
+	std::vector<PotentialContact> pairs;
+	for (auto _ : state) {
+		pairs.clear();
+		tree.findPairs(pairs);
+		benchmark::DoNotOptimize(pairs.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+	state.counters["pairs"] = (double)pairs.size();
+}
+BENCHMARK(BM_BoundingBoxTreeFindPairs)->RangeMultiplier(10)->Range(1000, 100000);
+
+// A frame of moving bodies: update every proxy, then find the pairs
+static void BM_BoundingBoxTreeStep(benchmark::State& state) {
+	BoxScene scene((unsigned)state.range(0));
+	BoundingBoxTree tree;
+	std::vector<unsigned> proxies;
+	scene.build(tree, proxies);
+	std::vector<PotentialContact> pairs;
+	const real duration = (real)1 / 60;
+	unsigned reinserted = 0;
+	for (auto _ : state) {
+		for (unsigned i = 0; i < proxies.size(); ++i) {
+			Vector3 displacement = scene.velocities[i] * duration;
+			BoundingBox& box = scene.boxes[i];
+			box = BoundingBox(box.minimum + displacement, box.maximum + displacement);
+			reinserted += tree.moveProxy(proxies[i], box, displacement);
+		}
+		pairs.clear();
+		tree.findPairs(pairs);
+		benchmark::DoNotOptimize(pairs.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+	state.counters["reinserted"] = (double)reinserted / (double)(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BoundingBoxTreeStep)->RangeMultiplier(10)->Range(1000, 100000);
+
+// All pairs reference, only up to sizes where it terminates in reasonable time
+static void BM_BruteForceBoxPairs(benchmark::State& state) {
+	BoxScene scene((unsigned)state.range(0));
+	std::vector<PotentialContact> pairs;
+	for (auto _ : state) {
+		pairs.clear();
+		unsigned count = (unsigned)scene.boxes.size();
+		for (unsigned i = 0; i < count; ++i) {
+			for (unsigned j = i + 1; j < count; ++j) {
+				if (scene.boxes[i].overlaps(scene.boxes[j])) {
+					PotentialContact contact = { { &scene.bodies[i], &scene.bodies[j] } };
+					pairs.push_back(contact);
+				}
+			}
+		}
+		benchmark::DoNotOptimize(pairs.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+	state.counters["pairs"] = (double)pairs.size();
+}
+// Capped at 10k boxes: the pair tests grow with the square of the count, 10k boxes already take 0.3 s
+// per iteration and 100k would take about 30 s. The tree benchmarks go to 100k
+BENCHMARK(BM_BruteForceBoxPairs)->RangeMultiplier(10)->Range(1000, 10000);
+
+// Closest box hit by rays across the scene
+static void BM_BoundingBoxTreeRaycast(benchmark::State& state) {
+	BoxScene scene((unsigned)state.range(0));
+	BoundingBoxTree tree;
+	std::vector<unsigned> proxies;
+	scene.build(tree, proxies);
+	real side = real_pow((real)state.range(0) * 8, (real)1 / 3);
+	unsigned hits = 0;
+	for (auto _ : state) {
+		Vector3 origin(scene.random() * side, scene.random() * side, -1);
+		Vector3 direction(scene.random() - (real)0.5, scene.random() - (real)0.5, 1);
+		real closest = side * 2;
+		tree.raycast(origin, direction, closest, [&closest](unsigned, real distance) {
+			if (distance < closest) {
+				closest = distance;
+			}
+			return closest;
+		});
+		hits += closest < side * 2;
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.counters["hit"] = (double)hits / (double)state.iterations();
+}
+BENCHMARK(BM_BoundingBoxTreeRaycast)->RangeMultiplier(10)->Range(1000, 100000);
\ No newline at end of file
@@ -0,0 +1,211 @@
+#include <vector>
+#include <benchmark/benchmark.h>
+
+#include "cyclone/core.h"
+
+using namespace cyclone;
+
+namespace {
+	// Report the configuration with the results, to compare the runs of builds with different options
+	const char* getPrecisionName() {
+#if defined(CYCLONE_DOUBLE_PRECISION)
+		return "double";
+#elif defined(CYCLONE_MIXED_PRECISION)
+		return "mixed (double positions)";
+#else
+		return "single";
+#endif
+	}
+
+	const char* getSimdName() {
+#if defined(CYCLONE_SIMD_AVX2)
+		return "AVX2";
+#elif defined(CYCLONE_SIMD_SSE)
+		return "SSE";
+#else
+		return "scalar";
+#endif
+	}
+
+	const bool contextAdded = (benchmark::AddCustomContext("cyclone_precision", getPrecisionName()),
+		benchmark::AddCustomContext("cyclone_simd", getSimdName()), true);
+
+	Matrix4 makeTransform() {
+		Matrix4 m;
+		Quaternion q(0.9f, 0.1f, 0.3f, -0.2f);
+		q.normalize();
+		m.setorientationAndPos(q, Vector3(1, 2, 3));
+		return m;
+	}
+
+	std::vector<Vector3> makeVectors(unsigned count) {
+		std::vector<Vector3> vectors(count);
+		for (unsigned i = 0; i < count; ++i) {
+			vectors[i] = Vector3((real)(i % 17) - 8, (real)(i % 5) + 1, (real)(i % 11) * 0.5f);
+		}
+		return vectors;
+	}
+}
+
+static void BM_Vector3AddScaledVector(benchmark::State& state) {
+	std::vector<Vector3> a = makeVectors((unsigned)state.range(0));
+	std::vector<Vector3> b = makeVectors((unsigned)state.range(0));
+	for (auto _ : state) {
+		for (size_t i = 0; i < a.size(); ++i) {
+			a[i].AddScaledVector(b[i], 0.016f);
+		}
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector3AddScaledVector)->Arg(1000)->Arg(100000);
+
+static void BM_Vector3CrossProduct(benchmark::State& state) {
+	std::vector<Vector3> a = makeVectors((unsigned)state.range(0));
+	std::vector<Vector3> b = makeVectors((unsigned)state.range(0));
+	for (auto _ : state) {
+		for (size_t i = 0; i < a.size(); ++i) {
+			a[i] = a[i] % b[i];
+		}
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector3CrossProduct)->Arg(1000)->Arg(100000);
+
+static void BM_Vector3Normalize(benchmark::State& state) {
+	std::vector<Vector3> source = makeVectors((unsigned)state.range(0));
+	std::vector<Vector3> a = source;
+	for (auto _ : state) {
+		for (size_t i = 0; i < a.size(); ++i) {
+			a[i].normalize();
+		}
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector3Normalize)->Arg(1000)->Arg(100000);
+
+static void BM_NormalizeVectors(benchmark::State& state) {
+	std::vector<Vector3> a = makeVectors((unsigned)state.range(0));
+	for (auto _ : state) {
+		normalizeVectors(a.data(), (unsigned)a.size());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_NormalizeVectors)->Arg(1000)->Arg(100000);
+
+static void BM_Matrix3SetInverse(benchmark::State& state) {
+	Matrix3 m(2, 0.1f, 0.3f, 0.2f, 3, 0.1f, 0.4f, 0.2f, 1.5f);
+	Matrix3 inverse;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(&m);
+		inverse.setInverse(m);
+		benchmark::DoNotOptimize(&inverse);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Matrix3SetInverse);
+
+static void BM_Matrix4Multiply(benchmark::State& state) {
+	Matrix4 a = makeTransform();
+	Matrix4 b = makeTransform();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(&a);
+		Matrix4 c = a * b;
+		benchmark::DoNotOptimize(&c);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Matrix4Multiply);
+
+static void BM_Matrix4SetInverse(benchmark::State& state) {
+	Matrix4 m = makeTransform();
+	Matrix4 inverse;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(&m);
+		inverse.setInverse(m);
+		benchmark::DoNotOptimize(&inverse);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Matrix4SetInverse);
+
+static void BM_Matrix4TransformVector(benchmark::State& state) {
+	Matrix4 m = makeTransform();
+	std::vector<Vector3> in = makeVectors((unsigned)state.range(0));
+	std::vector<Vector3> out(in.size());
+	for (auto _ : state) {
+		for (size_t i = 0; i < in.size(); ++i) {
+			out[i] = m * in[i];
+		}
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Matrix4TransformVector)->Arg(1000)->Arg(100000);
+
+static void BM_Matrix4TransformPoints(benchmark::State& state) {
+	Matrix4 m = makeTransform();
+	std::vector<Vector3> in = makeVectors((unsigned)state.range(0));
+	std::vector<Vector3> out(in.size());
+	for (auto _ : state) {
+		m.transformPoints(in.data(), out.data(), (unsigned)in.size());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Matrix4TransformPoints)->Arg(1000)->Arg(100000);
+
+static void BM_Matrix4TransformDirections(benchmark::State& state) {
+	Matrix4 m = makeTransform();
+	std::vector<Vector3> in = makeVectors((unsigned)state.range(0));
+	std::vector<Vector3> out(in.size());
+	for (auto _ : state) {
+		m.transformDirections(in.data(), out.data(), (unsigned)in.size());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Matrix4TransformDirections)->Arg(1000)->Arg(100000);
+
+static void BM_Matrix4TransformInverse(benchmark::State& state) {
+	Matrix4 m = makeTransform();
+	std::vector<Vector3> in = makeVectors((unsigned)state.range(0));
+	std::vector<Vector3> out(in.size());
+	for (auto _ : state) {
+		for (size_t i = 0; i < in.size(); ++i) {
+			out[i] = m.transformInverse(in[i]);
+		}
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Matrix4TransformInverse)->Arg(1000)->Arg(100000);
+
+static void BM_Matrix4TransformInversePoints(benchmark::State& state) {
+	Matrix4 m = makeTransform();
+	std::vector<Vector3> in = makeVectors((unsigned)state.range(0));
+	std::vector<Vector3> out(in.size());
+	for (auto _ : state) {
+		m.transformInversePoints(in.data(), out.data(), (unsigned)in.size());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Matrix4TransformInversePoints)->Arg(1000)->Arg(100000);
+
+static void BM_QuaternionMultiply(benchmark::State& state) {
+	Quaternion q(0.9f, 0.1f, 0.3f, -0.2f);
+	Quaternion r(0.7f, -0.2f, 0.1f, 0.4f);
+	q.normalize();
+	r.normalize();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(&r);
+		q *= r;
+		benchmark::DoNotOptimize(&q);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_QuaternionMultiply);
\ No newline at end of file
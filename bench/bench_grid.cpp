@@ -0,0 +1,146 @@
+#include <vector>
+#include <benchmark/benchmark.h>
+
+#include "cyclone/jobs.h"
+#include "cyclone/pgrid.h"
+#include "cyclone/pquery.h"
+#include "cyclone/pstore.h"
+
+using namespace cyclone;
+
+namespace {
+	// Particles of radius 0.5 spread in a slab at constant density, so the pair count grows linearly
+	void fillStore(ParticleStore& store, unsigned count) {
+		unsigned seed = 12345;
+		real side = real_sqrt((real)count) * 2;
+		store.reserve(count);
+		for (unsigned i = 0; i < count; ++i) {
+			seed = seed * 1664525u + 1013904223u;
+			real x = (real)(seed >> 8) / (real)(1 << 24) * side;
+			seed = seed * 1664525u + 1013904223u;
+			real z = (real)(seed >> 8) / (real)(1 << 24) * side;
+			seed = seed * 1664525u + 1013904223u;
+			real y = (real)(seed >> 8) / (real)(1 << 24) * 4;
+			store.createParticle()->setPosition(Vector3(x, y, z));
+		}
+	}
+}
+
+static void BM_ParticleGridBuild(benchmark::State& state) {
+	ParticleStore store;
+	fillStore(store, (unsigned)state.range(0));
+	ParticleGrid grid(1);
+	for (auto _ : state) {
+		grid.build(store);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ParticleGridBuild)->RangeMultiplier(10)->Range(1000, 1000000);
+
+static void BM_ParticleGridFindPairs(benchmark::State& state) {
+	ParticleStore store;
+	fillStore(store, (unsigned)state.range(0));
+	ParticleGrid grid(1);
+	std::vector<ParticlePair> pairs;
+	for (auto _ : state) {
+		grid.build(store);
+		pairs.clear();
+		grid.findPairs(pairs);
+		benchmark::DoNotOptimize(pairs.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+	state.counters["pairs"] = (double)pairs.size();
+}
+BENCHMARK(BM_ParticleGridFindPairs)->RangeMultiplier(10)->Range(1000, 1000000);
+
+// All pairs reference, only up to sizes where it terminates in reasonable time
+static void BM_BruteForcePairs(benchmark::State& state) {
+	ParticleStore store;
+	fillStore(store, (unsigned)state.range(0));
+	std::vector<ParticlePair> pairs;
+	for (auto _ : state) {
+		pairs.clear();
+		unsigned count = store.size();
+		for (unsigned i = 0; i < count; ++i) {
+			for (unsigned j = i + 1; j < count; ++j) {
+				real dx = store.positionX[i] - store.positionX[j];
+				real dy = store.positionY[i] - store.positionY[j];
+				real dz = store.positionZ[i] - store.positionZ[j];
+				if (dx * dx + dy * dy + dz * dz < 1) {
+					ParticlePair pair = { i, j };
+					pairs.push_back(pair);
+				}
+			}
+		}
+		benchmark::DoNotOptimize(pairs.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BruteForcePairs)->RangeMultiplier(10)->Range(1000, 10000);
+
+// Batch of 10000 rays of length 20 through range(0) particles of radius 0.5
+static void runRaycasts(benchmark::State& state, JobSystem* jobs) {
+	ParticleStore store;
+	fillStore(store, (unsigned)state.range(0));
+	ParticleQuery query(&store, (real)0.5);
+	query.update();
+
+	real side = real_sqrt((real)state.range(0)) * 2;
+	std::vector<ParticleRay> rays(10000);
+	std::vector<ParticleRayHit> hits(rays.size());
+	for (unsigned i = 0; i < rays.size(); ++i) {
+		Vector3 direction((real)(i % 7) - 3, (real)(i % 3) - 1, (real)(i % 5) - 2);
+		direction.normalize();
+		rays[i].origin = Vector3(side * (real)(i % 100) / 100, 2, side * (real)(i / 100) / 100);
+		rays[i].direction = direction.squareMagnitude() > 0 ? direction : Vector3(1, 0, 0);
+		rays[i].maxDistance = 20;
+	}
+
+	for (auto _ : state) {
+		if (jobs) {
+			query.raycast(rays.data(), (unsigned)rays.size(), hits.data(), *jobs);
+		}
+		else {
+			query.raycast(rays.data(), (unsigned)rays.size(), hits.data());
+		}
+		benchmark::DoNotOptimize(hits.data());
+	}
+	state.SetItemsProcessed(state.iterations() * rays.size());
+}
+
+static void BM_ParticleRaycast(benchmark::State& state) {
+	runRaycasts(state, 0);
+}
+BENCHMARK(BM_ParticleRaycast)->Arg(10000)->Arg(100000)->Arg(1000000);
+
+static void BM_ParticleRaycastParallel(benchmark::State& state) {
+	JobSystem jobs;
+	runRaycasts(state, &jobs);
+}
+BENCHMARK(BM_ParticleRaycastParallel)->Arg(10000)->Arg(100000)->Arg(1000000)->UseRealTime();
+
+// Batch of 1000 spheres of radius 3, up to 256 results each
+static void BM_ParticleSphereQuery(benchmark::State& state) {
+	ParticleStore store;
+	fillStore(store, (unsigned)state.range(0));
+	ParticleQuery query(&store, (real)0.5);
+	query.update();
+
+	real side = real_sqrt((real)state.range(0)) * 2;
+	const unsigned maxResults = 256;
+	std::vector<ParticleSphere> spheres(1000);
+	std::vector<unsigned> results(spheres.size() * maxResults);
+	std::vector<unsigned> resultCounts(spheres.size());
+	for (unsigned i = 0; i < spheres.size(); ++i) {
+		spheres[i].centre = Vector3(side * (real)(i % 32) / 32, 2, side * (real)(i / 32) / 32);
+		spheres[i].radius = 3;
+	}
+
+	for (auto _ : state) {
+		query.querySphere(spheres.data(), (unsigned)spheres.size(), results.data(), maxResults, resultCounts.data());
+		benchmark::DoNotOptimize(results.data());
+	}
+	state.SetItemsProcessed(state.iterations() * spheres.size());
+}
+BENCHMARK(BM_ParticleSphereQuery)->Arg(10000)->Arg(100000)->Arg(1000000);
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include <vector>
+#include <benchmark/benchmark.h>
+
+#include "cyclone/pfgen.h"
+#include "cyclone/pnetwork.h"
+#include "cyclone/pworld.h"
+
+using namespace cyclone;
+
+namespace {
+	// Hanging cloth: a grid of particles joined by stiff zero length springs to their right and lower
+	// neighbours, the top row held by anchored springs. In implicit mode the springs are the links of a
+	// ParticleSpringNetwork and the anchors fixed particles linked to the top row
+	class SpringMesh {
+	public:
+		enum { SIDE = 32 };
+
+		ParticleWorld world;
+		ParticleGravity gravity;
+		std::vector<Vector3> anchors;
+		std::vector<ParticleSpring> springs;
+		std::vector<ParticleAnchoredSpring> anchoredSprings;
+		ParticleSpringNetwork network;
+		bool implicit;
+
+		SpringMesh(ParticleWorld::Integrator integrator, real step, bool implicit = false) :
+			world(step, 1), gravity(Vector3(0, -9.81f, 0)), network(&world.getParticles()), implicit(implicit)
+		{
+			world.setIntegrator(integrator);
+			if (implicit) {
+				world.getSpringNetworks().push_back(&network);
+			}
+			anchors.reserve(SIDE);
+			springs.reserve(SIDE * SIDE * 4);
+			anchoredSprings.reserve(SIDE);
+
+			real spacing = 0.1f;
+			for (unsigned i = 0; i < SIDE * SIDE; ++i) {
+				Particle* particle = world.createParticle();
+				particle->setPosition(Vector3((i % SIDE) * spacing, -(real)(i / SIDE) * spacing, 0));
+				particle->setMass(0.05f);
+				particle->setDamping(0.9f);
+				world.getForceRegistry().add(particle, &gravity);
+			}
+
+			ParticleStore& particles = world.getParticles();
+			real stiffness = 400;
+			for (unsigned y = 0; y < SIDE; ++y) {
+				for (unsigned x = 0; x < SIDE; ++x) {
+					Particle* particle = particles.getParticle(y * SIDE + x);
+					if (x + 1 < SIDE) {
+						link(particle, particles.getParticle(y * SIDE + x + 1), stiffness);
+					}
+					if (y + 1 < SIDE) {
+						link(particle, particles.getParticle((y + 1) * SIDE + x), stiffness);
+					}
+				}
+			}
+			for (unsigned x = 0; x < SIDE; ++x) {
+				anchors.push_back(particles.getPosition(x));
+				if (implicit) {
+					Particle* anchor = world.createParticle();
+					anchor->setPosition(anchors.back());
+					anchor->setInverseMass(0);
+					network.addLink(particles.getParticle(x), anchor, stiffness * 10, 0);
+				}
+				else {
+					anchoredSprings.push_back(ParticleAnchoredSpring(&anchors.back(), stiffness * 10, 0));
+					world.getForceRegistry().add(particles.getParticle(x), &anchoredSprings.back());
+				}
+			}
+		}
+
+		void link(Particle* a, Particle* b, real stiffness) {
+			if (implicit) {
+				network.addLink(a, b, stiffness, 0);
+				return;
+			}
+			springs.push_back(ParticleSpring(b, stiffness, 0));
+			world.getForceRegistry().add(a, &springs.back());
+			springs.push_back(ParticleSpring(a, stiffness, 0));
+			world.getForceRegistry().add(b, &springs.back());
+		}
+
+		// True if the mesh stays finite and bounded for the given simulated time
+		bool isStable(real seconds) {
+			unsigned steps = (unsigned)(seconds / world.getFixedStep());
+			ParticleStore& particles = world.getParticles();
+			for (unsigned s = 0; s < steps; ++s) {
+				world.startFrame();
+				world.runPhysics(world.getFixedStep());
+			}
+			for (unsigned i = 0; i < particles.size(); ++i) {
+				Vector3 position = particles.getPosition(i);
+				real size = position.squareMagnitude();
+				if (!(size < 100)) {
+					return false;
+				}
+			}
+			return true;
+		}
+	};
+
+	// Largest step, among steps growing by 25% from half a millisecond, for which the mesh stays stable
+	// a few seconds. Returns zero if even the smallest one is unstable
+	real findLargestStableStep(ParticleWorld::Integrator integrator, bool implicit = false) {
+		const unsigned candidates = 28;
+		const real smallest = 0.0005f;
+
+		// Bisection over the candidates, assuming that a step is stable if a larger one is
+		int stable = -1;
+		int unstable = candidates;
+		while (unstable - stable > 1) {
+			int middle = (stable + unstable) / 2;
+			SpringMesh mesh(integrator, smallest * real_pow(1.25f, (real)middle), implicit);
+			if (mesh.isStable(2)) {
+				stable = middle;
+			}
+			else {
+				unstable = middle;
+			}
+		}
+		return stable < 0 ? 0 : smallest * real_pow(1.25f, (real)stable);
+	}
+}
+
+// Times the steps at the largest stable step of each integrator. sim_seconds/s is the simulated time per
+// second of CPU, the figure to compare: a costlier step can still win when it allows a much larger one
+static void BM_SpringMeshIntegrator(benchmark::State& state) {
+	ParticleWorld::Integrator integrator = (ParticleWorld::Integrator)state.range(0);
+	real step = findLargestStableStep(integrator);
+	if (step == 0) {
+		state.SkipWithError("Unstable even with the smallest step");
+		return;
+	}
+
+	SpringMesh mesh(integrator, step);
+	for (auto _ : state) {
+		mesh.world.startFrame();
+		mesh.world.runPhysics(step);
+	}
+
+	state.SetItemsProcessed(state.iterations() * SpringMesh::SIDE * SpringMesh::SIDE);
+	state.counters["max_step"] = step;
+	state.counters["sim_seconds/s"] = benchmark::Counter((double)state.iterations() * step, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_SpringMeshIntegrator)
+	->Arg(ParticleWorld::INTEGRATOR_EULER)
+	->Arg(ParticleWorld::INTEGRATOR_SYMPLECTIC_EULER)
+	->Arg(ParticleWorld::INTEGRATOR_VERLET)
+	->Arg(ParticleWorld::INTEGRATOR_RK4);
+
+
+// Same mesh solved by the implicit spring network, with the symplectic Euler integrator
+static void BM_SpringMeshImplicit(benchmark::State& state) {
+	real step = findLargestStableStep(ParticleWorld::INTEGRATOR_SYMPLECTIC_EULER, true);
+	if (step == 0) {
+		state.SkipWithError("Unstable even with the smallest step");
+		return;
+	}
+
+	SpringMesh mesh(ParticleWorld::INTEGRATOR_SYMPLECTIC_EULER, step, true);
+	for (auto _ : state) {
+		mesh.world.startFrame();
+		mesh.world.runPhysics(step);
+	}
+
+	state.SetItemsProcessed(state.iterations() * SpringMesh::SIDE * SpringMesh::SIDE);
+	state.counters["max_step"] = step;
+	state.counters["sim_seconds/s"] = benchmark::Counter((double)state.iterations() * step, benchmark::Counter::kIsRate);
+	state.counters["cg_iterations"] = mesh.network.getIterationsUsed();
+}
+BENCHMARK(BM_SpringMeshImplicit);
\ No newline at end of file
@@ -0,0 +1,332 @@
+#include <vector>
+#include <benchmark/benchmark.h>
+
+#include "cyclone/jobs.h"
+#include "cyclone/parea.h"
+#include "cyclone/particle.h"
+#include "cyclone/pfgen.h"
+#include "cyclone/pquery.h"
+#include "cyclone/pstore.h"
+#include "cyclone/pworld.h"
+
+using namespace cyclone;
+
+namespace {
+	const real timeStep = ((real)1.0) / 60;
+
+	void setupParticle(Particle& particle, unsigned i) {
+		particle.setPosition(Vector3((real)(i % 100), (real)(i / 100 % 100), (real)(i / 10000)));
+		particle.setVelocity(Vector3(1, 2, 0));
+		particle.setMass(1 + (real)(i % 3));
+		particle.setDamping(0.99f);
+	}
+
+	// Reports the particles processed per second by a benchmark running range(0) particles per iteration
+	void setParticleCounters(benchmark::State& state) {
+		state.SetItemsProcessed(state.iterations() * state.range(0));
+		state.counters["particles/s"] = benchmark::Counter((double)(state.iterations() * state.range(0)), benchmark::Counter::kIsRate);
+	}
+}
+
+static void BM_ParticleIntegrate(benchmark::State& state) {
+	std::vector<Particle> particles((size_t)state.range(0));
+	for (unsigned i = 0; i < particles.size(); ++i) {
+		setupParticle(particles[i], i);
+	}
+	for (auto _ : state) {
+		for (size_t i = 0; i < particles.size(); ++i) {
+			particles[i].integrate(timeStep);
+		}
+		benchmark::ClobberMemory();
+	}
+	setParticleCounters(state);
+}
+BENCHMARK(BM_ParticleIntegrate)->Arg(1000)->Arg(100000)->Arg(1000000);
+
+static void runStoreIntegrateAll(benchmark::State& state, bool hashed) {
+	ParticleStore store;
+	store.reserve((unsigned)state.range(0));
+	for (unsigned i = 0; i < state.range(0); ++i) {
+		setupParticle(*store.createParticle(), i);
+	}
+	store.setStateHashing(hashed);
+	for (auto _ : state) {
+		store.integrateAll(timeStep);
+		benchmark::ClobberMemory();
+	}
+	setParticleCounters(state);
+}
+
+static void BM_ParticleStoreIntegrateAll(benchmark::State& state) {
+	runStoreIntegrateAll(state, false);
+}
+BENCHMARK(BM_ParticleStoreIntegrateAll)->Arg(1000)->Arg(100000)->Arg(1000000);
+
+// Keeping the state hash up to date, see ParticleStore::setStateHashing
+static void BM_ParticleStoreIntegrateAllHashed(benchmark::State& state) {
+	runStoreIntegrateAll(state, true);
+}
+BENCHMARK(BM_ParticleStoreIntegrateAllHashed)->Arg(1000)->Arg(100000)->Arg(1000000);
+
+// Particles of a store integrated one by one through their handles
+static void BM_ParticleStoreIntegrateHandles(benchmark::State& state) {
+	ParticleStore store;
+	store.reserve((unsigned)state.range(0));
+	for (unsigned i = 0; i < state.range(0); ++i) {
+		setupParticle(*store.createParticle(), i);
+	}
+	for (auto _ : state) {
+		for (unsigned i = 0; i < store.size(); ++i) {
+			store.getParticle(i)->integrate(timeStep);
+		}
+		benchmark::ClobberMemory();
+	}
+	setParticleCounters(state);
+}
+BENCHMARK(BM_ParticleStoreIntegrateHandles)->Arg(1000)->Arg(100000)->Arg(1000000);
+
+// Same with a few different damping values interleaved
+static void BM_ParticleStoreIntegrateAllMixedDamping(benchmark::State& state) {
+	ParticleStore store;
+	store.reserve((unsigned)state.range(0));
+	for (unsigned i = 0; i < state.range(0); ++i) {
+		Particle* particle = store.createParticle();
+		setupParticle(*particle, i);
+		particle->setDamping(0.95f + 0.01f * (i % 4));
+	}
+	for (auto _ : state) {
+		store.integrateAll(timeStep);
+		benchmark::ClobberMemory();
+	}
+	setParticleCounters(state);
+}
+BENCHMARK(BM_ParticleStoreIntegrateAllMixedDamping)->Arg(1000)->Arg(100000)->Arg(1000000);
+
+// Gravity and drag on every particle, plus a spring to the previous particle
+static void runUpdateForces(benchmark::State& state, bool bucketed, JobSystem* jobs) {
+	unsigned count = (unsigned)state.range(0);
+	ParticleStore store;
+	store.reserve(count);
+	for (unsigned i = 0; i < count; ++i) {
+		setupParticle(*store.createParticle(), i);
+	}
+
+	ParticleForceRegistry registry(bucketed);
+	ParticleGravity gravity(Vector3(0, -9.81f, 0));
+	ParticleDrag drag(0.1f, 0.01f);
+	std::vector<ParticleSpring> springs;
+	springs.reserve(count);
+	for (unsigned i = 0; i < count; ++i) {
+		Particle* particle = store.getParticle(i);
+		registry.add(particle, &gravity);
+		registry.add(particle, &drag);
+		springs.push_back(ParticleSpring(store.getParticle(i > 0 ? i - 1 : 0), 10, 1));
+		registry.add(particle, &springs.back());
+	}
+
+	for (auto _ : state) {
+		if (jobs) {
+			registry.updateForces(timeStep, *jobs);
+		}
+		else {
+			registry.updateForces(timeStep);
+		}
+		store.clearAccumulators();
+		benchmark::ClobberMemory();
+	}
+	setParticleCounters(state);
+}
+
+static void BM_RegistryUpdateForces(benchmark::State& state) {
+	runUpdateForces(state, false, 0);
+}
+BENCHMARK(BM_RegistryUpdateForces)->Arg(1000)->Arg(100000)->Arg(1000000);
+
+static void BM_RegistryUpdateForcesBucketed(benchmark::State& state) {
+	runUpdateForces(state, true, 0);
+}
+BENCHMARK(BM_RegistryUpdateForcesBucketed)->Arg(1000)->Arg(100000)->Arg(1000000);
+
+static void BM_RegistryUpdateForcesParallel(benchmark::State& state) {
+	JobSystem jobs;
+	runUpdateForces(state, true, &jobs);
+}
+BENCHMARK(BM_RegistryUpdateForcesParallel)->Arg(1000)->Arg(100000)->Arg(1000000)->UseRealTime();
+
+// Gravity and drag shared by every particle: one registration per particle against a single field pass
+static void runSharedGenerators(benchmark::State& state, bool fields) {
+	unsigned count = (unsigned)state.range(0);
+	ParticleStore store;
+	store.reserve(count);
+	for (unsigned i = 0; i < count; ++i) {
+		setupParticle(*store.createParticle(), i);
+	}
+
+	ParticleForceRegistry registry(true);
+	ParticleGravity gravity(Vector3(0, -9.81f, 0));
+	ParticleDrag drag(0.1f, 0.01f);
+	if (!fields) {
+		for (unsigned i = 0; i < count; ++i) {
+			registry.add(store.getParticle(i), &gravity);
+			registry.add(store.getParticle(i), &drag);
+		}
+	}
+
+	for (auto _ : state) {
+		if (fields) {
+			gravity.updateForces(&store, 0, count, timeStep);
+			drag.updateForces(&store, 0, count, timeStep);
+		}
+		else {
+			registry.updateForces(timeStep);
+		}
+		store.clearAccumulators();
+		benchmark::ClobberMemory();
+	}
+	setParticleCounters(state);
+}
+
+static void BM_SharedGeneratorsRegistry(benchmark::State& state) {
+	runSharedGenerators(state, false);
+}
+BENCHMARK(BM_SharedGeneratorsRegistry)->Arg(1000)->Arg(100000)->Arg(1000000);
+
+static void BM_SharedGeneratorsFields(benchmark::State& state) {
+	runSharedGenerators(state, true);
+}
+BENCHMARK(BM_SharedGeneratorsFields)->Arg(1000)->Arg(100000)->Arg(1000000);
+
+// Spawn range(0) projectiles, each with its own drag generator, then despawn them all
+static void runSpawnDespawn(benchmark::State& state, bool pooled) {
+	ParticleWorld world;
+	std::vector<Particle*> projectiles((size_t)state.range(0));
+	std::vector<ParticleDrag*> drags((size_t)state.range(0));
+	for (auto _ : state) {
+		for (unsigned i = 0; i < projectiles.size(); ++i) {
+			projectiles[i] = world.createParticle();
+			setupParticle(*projectiles[i], i);
+			drags[i] = pooled ? world.createGenerator<ParticleDrag>(0.1f, 0.01f) : new ParticleDrag(0.1f, 0.01f);
+			world.getForceRegistry().add(projectiles[i], drags[i]);
+		}
+		for (unsigned i = 0; i < projectiles.size(); ++i) {
+			world.destroyParticle(projectiles[i]);
+			if (pooled) {
+				world.destroyGenerator(drags[i]);
+			}
+			else {
+				// The generator base has no virtual destructor, so destroy through the exact type
+				drags[i]->~ParticleDrag();
+				::operator delete(drags[i]);
+			}
+		}
+		benchmark::ClobberMemory();
+	}
+	setParticleCounters(state);
+}
+
+static void BM_SpawnDespawnHeap(benchmark::State& state) {
+	runSpawnDespawn(state, false);
+}
+BENCHMARK(BM_SpawnDespawnHeap)->Arg(1000)->Arg(100000);
+
+static void BM_SpawnDespawnPooled(benchmark::State& state) {
+	runSpawnDespawn(state, true);
+}
+BENCHMARK(BM_SpawnDespawnPooled)->Arg(1000)->Arg(100000);
+
+// Per frame forces on live particles, released by startFrame
+static void BM_TransientForces(benchmark::State& state) {
+	ParticleWorld world;
+	std::vector<Particle*> particles((size_t)state.range(0));
+	for (unsigned i = 0; i < particles.size(); ++i) {
+		particles[i] = world.createParticle();
+		setupParticle(*particles[i], i);
+	}
+	for (auto _ : state) {
+		world.startFrame();
+		for (unsigned i = 0; i < particles.size(); ++i) {
+			world.addTransientForce(particles[i], world.createTransientGenerator<ParticleDrag>(0.1f, 0.01f));
+		}
+		benchmark::ClobberMemory();
+	}
+	setParticleCounters(state);
+}
+BENCHMARK(BM_TransientForces)->Arg(1000)->Arg(100000);
+
+static void runStateHash(benchmark::State& state, bool incremental) {
+	ParticleWorld world;
+	for (unsigned i = 0; i < state.range(0); ++i) {
+		setupParticle(*world.createParticle(), i);
+	}
+	world.getParticles().setStateHashing(incremental);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(world.getStateHash());
+	}
+	setParticleCounters(state);
+}
+
+// A pass over all the particles
+static void BM_WorldStateHash(benchmark::State& state) {
+	runStateHash(state, false);
+}
+BENCHMARK(BM_WorldStateHash)->Arg(1000)->Arg(10000)->Arg(100000)->Arg(1000000);
+
+// The step keeps the hash up to date, reading it does not depend on the particle count
+static void BM_WorldStateHashIncremental(benchmark::State& state) {
+	runStateHash(state, true);
+}
+BENCHMARK(BM_WorldStateHashIncremental)->Arg(1000)->Arg(1000000);
+
+
+// A small explosion in a large world: the query finds the thousand particles it reaches, the scan tests them all.
+// Late, the shockwave of a large explosion has grown past most of the world, its bounding cube holding more
+// cells of the default size than there are particles
+static void runExplosion(benchmark::State& state, bool culled, bool late) {
+	ParticleStore store;
+	for (unsigned i = 0; i < (unsigned)state.range(0); ++i) {
+		setupParticle(*store.createParticle(), i);
+	}
+	ParticleQuery query(&store, ((real)0.5), late ? 0 : 2);
+	query.update();
+
+	ParticleExplosion explosion(Vector3(50, 50, 5));
+	if (late) {
+		explosion.shockwaveSpeed = 30;
+		explosion.shockwaveThickness = 2;
+		explosion.peakConcussionForce = 100;
+		explosion.concussionDuration = 3;
+		explosion.advance(2);
+	}
+	else {
+		explosion.implosionMaxRadius = 6;
+		explosion.implosionMinRadius = 1;
+		explosion.implosionDuration = 1;
+		explosion.implosionForce = 10;
+	}
+
+	for (auto _ : state) {
+		explosion.apply(&store, culled ? &query : 0, timeStep, 0);
+		benchmark::ClobberMemory();
+	}
+	setParticleCounters(state);
+}
+
+static void BM_ExplosionCulled(benchmark::State& state) {
+	runExplosion(state, true, false);
+}
+BENCHMARK(BM_ExplosionCulled)->Arg(100000)->Arg(1000000);
+
+static void BM_ExplosionScan(benchmark::State& state) {
+	runExplosion(state, false, false);
+}
+BENCHMARK(BM_ExplosionScan)->Arg(100000)->Arg(1000000);
+
+static void BM_ExplosionShockwaveCulled(benchmark::State& state) {
+	runExplosion(state, true, true);
+}
+BENCHMARK(BM_ExplosionShockwaveCulled)->Arg(100000)->Arg(1000000);
+
+static void BM_ExplosionShockwaveScan(benchmark::State& state) {
+	runExplosion(state, false, true);
+}
+BENCHMARK(BM_ExplosionShockwaveScan)->Arg(100000)->Arg(1000000);
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include <cstdio>
+#include <benchmark/benchmark.h>
+
+#include "cyclone/preplay.h"
+#include "cyclone/pworld.h"
+
+using namespace cyclone;
+
+namespace {
+	const char* replayFile = "cyclone_bench_replay.bin";
+
+	// Step a world of range(0) particles under gravity and drag, recording each step when asked
+	void runRecordedStep(benchmark::State& state, bool record, bool recordVelocities) {
+		ParticleWorld world;
+		ParticleGravity gravity(Vector3(0, -9.81f, 0));
+		ParticleDrag drag(0.1f, 0.01f);
+		for (unsigned i = 0; i < state.range(0); ++i) {
+			Particle* particle = world.createParticle();
+			particle->setPosition(Vector3((real)(i % 100), (real)(i / 100 % 100), (real)(i / 10000)));
+			particle->setVelocity(Vector3(1, 2, 0));
+			particle->setMass(1 + (real)(i % 3));
+			particle->setDamping(0.99f);
+			world.getForceRegistry().add(particle, &gravity);
+			world.getForceRegistry().add(particle, &drag);
+		}
+
+		ParticleReplayRecorder recorder;
+		if (record) {
+			recorder.open(replayFile, 1e-4, 1e-3, 60, recordVelocities);
+			world.setRecorder(&recorder);
+		}
+		for (auto _ : state) {
+			world.startFrame();
+			world.runPhysics(world.getFixedStep());
+		}
+		world.setRecorder(0);
+		recorder.close();
+		std::remove(replayFile);
+
+		state.counters["particles/s"] = benchmark::Counter((double)(state.iterations() * state.range(0)), benchmark::Counter::kIsRate);
+	}
+}
+
+static void BM_WorldStep(benchmark::State& state) {
+	runRecordedStep(state, false, false);
+}
+BENCHMARK(BM_WorldStep)->Arg(100000)->UseRealTime();
+
+static void BM_WorldStepRecorded(benchmark::State& state) {
+	runRecordedStep(state, true, true);
+}
+BENCHMARK(BM_WorldStepRecorded)->Arg(100000)->UseRealTime();
+
+static void BM_WorldStepRecordedPositions(benchmark::State& state) {
+	runRecordedStep(state, true, false);
+}
+BENCHMARK(BM_WorldStepRecordedPositions)->Arg(100000)->UseRealTime();
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include <cstdio>
+#include <vector>
+#include <benchmark/benchmark.h>
+
+#include "cyclone/psnapshot.h"
+#include "cyclone/pworld.h"
+
+using namespace cyclone;
+
+namespace {
+	const char* snapshotFile = "cyclone_bench_snapshot.bin";
+	const char* deltaFile = "cyclone_bench_delta.bin";
+
+	// World of range(0) particles under a shared gravity generator, stepped once so every array is set
+	struct SnapshotScene {
+		ParticleWorld world;
+		ParticleGravity gravity;
+		GeneratorTable generators;
+
+		SnapshotScene(unsigned count) : gravity(Vector3(0, -9.81f, 0)) {
+			world.getParticles().reserve(count);
+			for (unsigned i = 0; i < count; ++i) {
+				Particle* particle = world.createParticle();
+				particle->setPosition(Vector3((real)(i % 1000), (real)(i / 1000), 0));
+				particle->setDamping(0.99f);
+				world.getForceRegistry().add(particle, &gravity);
+			}
+			generators.push_back(&gravity);
+			world.startFrame();
+			world.runPhysics(world.getFixedStep());
+		}
+
+		// Move one particle in a hundred
+		void touch() {
+			ParticleStore& particles = world.getParticles();
+			for (unsigned i = 0; i < particles.size(); i += 100) {
+				particles.positionX[i] += 1;
+			}
+		}
+	};
+
+	void setSnapshotCounters(benchmark::State& state) {
+		state.counters["particles/s"] = benchmark::Counter((double)(state.iterations() * state.range(0)), benchmark::Counter::kIsRate);
+	}
+}
+
+static void BM_SnapshotWriteFull(benchmark::State& state) {
+	SnapshotScene scene((unsigned)state.range(0));
+	ParticleSnapshotWriter writer;
+	for (auto _ : state) {
+		writer.writeFull(snapshotFile, scene.world, scene.generators);
+	}
+	setSnapshotCounters(state);
+	std::remove(snapshotFile);
+}
+BENCHMARK(BM_SnapshotWriteFull)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// One particle in a hundred changed since the previous snapshot
+static void BM_SnapshotWriteDelta(benchmark::State& state) {
+	SnapshotScene scene((unsigned)state.range(0));
+	ParticleSnapshotWriter writer;
+	writer.writeFull(snapshotFile, scene.world, scene.generators);
+	for (auto _ : state) {
+		state.PauseTiming();
+		scene.touch();
+		state.ResumeTiming();
+		writer.writeDelta(deltaFile, scene.world, scene.generators);
+	}
+	state.counters["records"] = (double)writer.getLastRecordCount();
+	setSnapshotCounters(state);
+	std::remove(snapshotFile);
+	std::remove(deltaFile);
+}
+BENCHMARK(BM_SnapshotWriteDelta)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Map the file and roll the world back to it
+static void BM_SnapshotRestore(benchmark::State& state) {
+	SnapshotScene scene((unsigned)state.range(0));
+	ParticleSnapshotWriter writer;
+	writer.writeFull(snapshotFile, scene.world, scene.generators);
+	for (auto _ : state) {
+		ParticleSnapshotFile file;
+		file.open(snapshotFile);
+		file.restore(scene.world, scene.generators);
+	}
+	setSnapshotCounters(state);
+	std::remove(snapshotFile);
+}
+BENCHMARK(BM_SnapshotRestore)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond)->UseRealTime();
\ No newline at end of file
@@ -0,0 +1,143 @@
+#ifndef CYCLONE_BODY_H
+#define CYCLONE_BODY_H
+
+#include "core.h"
+#include "precision.h"
+
+namespace cyclone {
+
+	// A rigid body: linear and angular motion of an object with mass and inertia tensor.
+	// The derived data (transform matrix and world space inverse inertia tensor) is a cache rebuilt
+	// lazily, only after the position or the orientation changed
+	class RigidBody {
+	protected:
+		real inverseMass;
+		Matrix3 inverseInertiaTensor; // Inverse of the inertia tensor in body space
+
+		real linearDamping; // Amount of damping applied to linear motion
+		real angularDamping; // Amount of damping applied to angular motion
+		real linearDampingFactor; // Cached real_pow(linearDamping, dampingDuration)
+		real angularDampingFactor; // Cached real_pow(angularDamping, dampingDuration)
+
+		Vector3 position; // Linear position in world space
+		Quaternion orientation; // Angular orientation in world space
+		Vector3 velocity; // Linear velocity in world space
+		Vector3 rotation; // Angular velocity in world space
+
+		// Derived data, valid when derivedDataDirty is false
+		mutable Matrix3 inverseInertiaTensorWorld;
+		mutable Matrix4 transformMatrix; // Body space to world space
+		mutable bool derivedDataDirty;
+
+		Vector3 forceAccum; // Accumulated force to be applied at the next integration step
+		Vector3 torqueAccum; // Accumulated torque to be applied at the next integration step
+
+		Vector3 acceleration; // Constant acceleration (e.g. gravity)
+		Vector3 lastFrameAcceleration; // Linear acceleration of the last frame
+
+		real motion; // Low-pass filtered kinetic energy, used to decide when to sleep
+		real sleepBias; // Cached real_pow(0.5, dampingDuration), weight of the previous motion in the average
+		real dampingDuration; // Duration of the cached factors, zero when they must be recomputed
+		bool isAwake; // Sleeping bodies are not integrated
+		bool canSleep; // Some bodies may never sleep (e.g. user controlled ones)
+
+		// Recompute the derived data, whether dirty or not
+		void updateDerivedData() const;
+
+	public:
+		RigidBody();
+
+		// Recompute the derived data if the position or the orientation changed since the last call
+		void calculateDerivedData() const {
+			if (derivedDataDirty) {
+				updateDerivedData();
+			}
+		}
+
+		// Bring the derived data of an array of bodies up to date in a single pass
+		static void calculateDerivedData(RigidBody* bodies, unsigned count);
+
+		// Integrate the rigid body forward in time
+		void integrate(real duration);
+
+		void setMass(const real mass);
+		real getMass() const;
+
+		void setInverseMass(const real inverseMass);
+		real getInverseMass() const { return inverseMass; }
+
+		bool hasFiniteMass() const { return inverseMass >= 0.0f; }
+
+		// Set the inertia tensor in body space
+		void setInertiaTensor(const Matrix3& inertiaTensor);
+
+		void setInverseInertiaTensor(const Matrix3& inverseInertiaTensor);
+		Matrix3 getInverseInertiaTensor() const { return inverseInertiaTensor; }
+
+		// Inverse inertia tensor in world space
+		Matrix3 getInverseInertiaTensorWorld() const;
+
+		void setDamping(const real linearDamping, const real angularDamping);
+		real getLinearDamping() const { return linearDamping; }
+		real getAngularDamping() const { return angularDamping; }
+
+		void setPosition(const Vector3& position);
+		Vector3 getPosition() const { return position; }
+
+		// The orientation is normalized when set
+		void setOrientation(const Quaternion& orientation);
+		Quaternion getOrientation() const { return orientation; }
+
+		void setVelocity(const Vector3& velocity) { RigidBody::velocity = velocity; }
+		Vector3 getVelocity() const { return velocity; }
+
+		void addVelocity(const Vector3& deltaVelocity) { velocity += deltaVelocity; }
+
+		void setRotation(const Vector3& rotation) { RigidBody::rotation = rotation; }
+		Vector3 getRotation() const { return rotation; }
+
+		void addRotation(const Vector3& deltaRotation) { rotation += deltaRotation; }
+
+		void setAcceleration(const Vector3& acceleration) { RigidBody::acceleration = acceleration; }
+		Vector3 getAcceleration() const { return acceleration; }
+
+		Vector3 getLastFrameAcceleration() const { return lastFrameAcceleration; }
+
+		// Body space to world space transform
+		const Matrix4& getTransform() const;
+
+		// Convert a point between body and world space
+		Vector3 getPointInWorldSpace(const Vector3& point) const;
+		Vector3 getPointInLocalSpace(const Vector3& point) const;
+
+		// Convert a direction between body and world space
+		Vector3 getDirectionInWorldSpace(const Vector3& direction) const;
+		Vector3 getDirectionInLocalSpace(const Vector3& direction) const;
+
+		// Sleeping state. Putting a body to sleep zeroes its velocities, waking it up gives it some
+		// motion so it does not fall asleep again immediately
+		bool getAwake() const { return isAwake; }
+		void setAwake(const bool awake = true);
+
+		// Allow the body to sleep when it has been at rest for a while, off by default
+		bool getCanSleep() const { return canSleep; }
+		void setCanSleep(const bool canSleep = true);
+
+		// Clear the forces and torques in the accumulators
+		void clearAccumulators();
+
+		// Add a force applied at the center of mass, waking the body up
+		void addForce(const Vector3& force);
+
+		// Add a force applied at a point given in world space, waking the body up
+		void addForceAtPoint(const Vector3& force, const Vector3& point);
+
+		// Add a force applied at a point given in body space, waking the body up
+		void addForceAtBodyPoint(const Vector3& force, const Vector3& point);
+
+		// Add a torque, waking the body up
+		void addTorque(const Vector3& torque);
+	};
+}
+
+#endif// CYCLONE_BODY_H
\ No newline at end of file
@@ -0,0 +1,191 @@
+#ifndef CYCLONE_COLLIDE_COARSE_H
+#define CYCLONE_COLLIDE_COARSE_H
+
+#include <assert.h>
+#include <vector>
+
+#include "precision.h"
+#include "body.h"
+#include "core.h"
+
+namespace cyclone {
+
+	// Pair of rigid bodies which might be in contact, found by the coarse collision detection
+	struct PotentialContact {
+		RigidBody* body[2];
+	};
+
+	// Axis aligned bounding box
+	struct BoundingBox {
+		Vector3 minimum;
+		Vector3 maximum;
+
+		BoundingBox() {}
+		BoundingBox(const Vector3& minimum, const Vector3& maximum) : minimum(minimum), maximum(maximum) {}
+
+		// Smallest box enclosing the two given boxes
+		BoundingBox(const BoundingBox& one, const BoundingBox& two);
+
+		bool overlaps(const BoundingBox& other) const {
+			return minimum.x <= other.maximum.x && other.minimum.x <= maximum.x &&
+				minimum.y <= other.maximum.y && other.minimum.y <= maximum.y &&
+				minimum.z <= other.maximum.z && other.minimum.z <= maximum.z;
+		}
+
+		bool contains(const BoundingBox& other) const {
+			return minimum.x <= other.minimum.x && other.maximum.x <= maximum.x &&
+				minimum.y <= other.minimum.y && other.maximum.y <= maximum.y &&
+				minimum.z <= other.minimum.z && other.maximum.z <= maximum.z;
+		}
+
+		// Surface area, the cost of a volume in the tree: the chance that a random ray or box hits it
+		real getSize() const;
+
+		// Growth in size of this box if it had to enclose the other one
+		real getGrowth(const BoundingBox& other) const;
+
+		// True if the ray origin + t * direction enters the box for some t in [0, maxDistance], where
+		// inverseDirection holds the reciprocals of the components of the direction. distance is set
+		// to the entry point
+		bool intersectsRay(const Vector3& origin, const Vector3& inverseDirection, real maxDistance, real& distance) const;
+	};
+
+	// Dynamic bounding volume hierarchy over boxes: the broadphase of the rigid bodies. Each body is a
+	// proxy whose box is enlarged by a margin (a fat box), so a body moving a little stays inside it and
+	// the tree is left alone. Only a body leaving its fat box is removed and inserted again. Insertion
+	// picks the sibling with the least growth in surface area and rotations keep the tree balanced, so
+	// queries stay logarithmic whatever the order of the insertions.
+	//
+	// The nodes live in a single array linked by indices, with a free list, so proxies are created and
+	// destroyed without allocating once the array has grown. A proxy is the index of its leaf node and
+	// stays valid until destroyed
+	class BoundingBoxTree {
+	public:
+		enum { NULL_NODE = 0xffffffff };
+
+	protected:
+		// Nodes are aligned on cache lines, so a node never straddles two lines: one line per node in
+		// float builds, two in double builds where the boxes make it larger than a line
+		struct alignas(64) Node {
+			BoundingBox box; // Fat box for the leaves
+			RigidBody* body; // Leaves only
+			unsigned parent; // Next free node when in the free list
+			unsigned child[2]; // NULL_NODE for the leaves
+			int height; // 0 for the leaves, -1 for the free nodes
+
+			bool isLeaf() const { return child[0] == NULL_NODE; }
+		};
+
+		std::vector<Node> nodes;
+		unsigned root;
+		unsigned freeList;
+		unsigned proxyCount;
+
+		real margin; // Added on each side of the boxes of the proxies
+		real displacementMultiplier; // Extension of the fat boxes in the direction of motion
+
+		// Deepest traversal stack, the balanced tree stays far below it
+		enum { MAX_STACK = 256 };
+
+		unsigned allocateNode();
+		void freeNode(unsigned node);
+
+		void insertLeaf(unsigned leaf);
+		void removeLeaf(unsigned leaf);
+
+		// Rotate the subtree rooted at the node if it is unbalanced, return the new root of the subtree
+		unsigned balance(unsigned node);
+
+		// Recompute the boxes and heights from the node up to the root, balancing on the way
+		void refit(unsigned node);
+
+		// Report the overlapping leaves between two subtrees, and within a subtree
+		void findPairs(unsigned one, unsigned two, std::vector<PotentialContact>& pairs) const;
+		void findPairs(unsigned node, std::vector<PotentialContact>& pairs) const;
+
+	public:
+		// margin is added around the box of each proxy, displacementMultiplier scales the motion given
+		// to moveProxy to stretch the fat box ahead of the body
+		BoundingBoxTree(real margin = (real)0.1, real displacementMultiplier = 2);
+
+		// Add a body with the given box, return its proxy
+		unsigned createProxy(const BoundingBox& box, RigidBody* body);
+
+		void destroyProxy(unsigned proxy);
+
+		// Update the box of a proxy after its body moved by displacement. Return true if the box left
+		// the fat box and the proxy was inserted again
+		bool moveProxy(unsigned proxy, const BoundingBox& box, const Vector3& displacement);
+
+		const BoundingBox& getFatBox(unsigned proxy) const { return nodes[proxy].box; }
+		RigidBody* getBody(unsigned proxy) const { return nodes[proxy].body; }
+
+		// Number of proxies in the tree
+		unsigned size() const { return proxyCount; }
+
+		// Height of the tree, 0 with a single proxy
+		int getHeight() const { return root == NULL_NODE ? 0 : nodes[root].height; }
+
+		// Make room for count proxies
+		void reserve(unsigned count);
+
+		// Append to pairs every pair of bodies whose fat boxes overlap, each pair once
+		void findPairs(std::vector<PotentialContact>& pairs) const;
+
+		// Call callback(proxy) for each proxy whose fat box overlaps the box, until it returns false
+		template<class Callback>
+		void query(const BoundingBox& box, Callback callback) const {
+			unsigned stack[MAX_STACK];
+			unsigned top = 0;
+			if (root != NULL_NODE) {
+				stack[top++] = root;
+			}
+			while (top > 0) {
+				const Node& node = nodes[stack[--top]];
+				if (!node.box.overlaps(box)) {
+					continue;
+				}
+				if (node.isLeaf()) {
+					if (!callback((unsigned)(&node - nodes.data()))) {
+						return;
+					}
+				}
+				else {
+					assert(top + 2 <= MAX_STACK);
+					stack[top++] = node.child[0];
+					stack[top++] = node.child[1];
+				}
+			}
+		}
+
+		// Cast the ray origin + t * direction, t in [0, maxDistance], and call callback(proxy, t) for the
+		// proxies whose fat box it enters at t. The callback returns the new maxDistance: maxDistance
+		// to go on, the distance of a hit on the body to keep only closer ones, 0 to stop
+		template<class Callback>
+		void raycast(const Vector3& origin, const Vector3& direction, real maxDistance, Callback callback) const {
+			Vector3 inverseDirection(1 / direction.x, 1 / direction.y, 1 / direction.z);
+			unsigned stack[MAX_STACK];
+			unsigned top = 0;
+			if (root != NULL_NODE) {
+				stack[top++] = root;
+			}
+			while (top > 0 && maxDistance > 0) {
+				const Node& node = nodes[stack[--top]];
+				real distance;
+				if (!node.box.intersectsRay(origin, inverseDirection, maxDistance, distance)) {
+					continue;
+				}
+				if (node.isLeaf()) {
+					maxDistance = callback((unsigned)(&node - nodes.data()), distance);
+				}
+				else {
+					assert(top + 2 <= MAX_STACK);
+					stack[top++] = node.child[0];
+					stack[top++] = node.child[1];
+				}
+			}
+		}
+	};
+}
+
+#endif// CYCLONE_COLLIDE_COARSE_H
\ No newline at end of file
@@ -2,10 +2,21 @@
 #define	CYCLONE_CORE_H
 
 #include "precision.h"
+#include "simd.h"
 
 namespace cyclone {
 
-	class Vector3 {
+	// Holds the value for energy under which a body or particle is put to sleep.
+	// The value is global to the whole engine
+	extern real sleepEpsilon;
+
+	// Change the value of the sleep epsilon
+	void setSleepEpsilon(real value);
+
+	// Get the current value of the sleep epsilon
+	real getSleepEpsilon();
+
+	class CYCLONE_ALIGN16 Vector3 {
 	public:
 		real x;
 		real y;
@@ -18,13 +29,25 @@ namespace cyclone {
 		Vector3() : x(0), y(0), z(0), pad(0) {}
 
 		// Parametric constructor
-		Vector3(const real x, const real y, const real z) : x(x), y(y), z(z) {}
+		Vector3(const real x, const real y, const real z) : x(x), y(y), z(z), pad(0) {}
+
+#if defined(CYCLONE_SIMD_SSE)
+		// Build the vector from a register, the fourth lane is expected to be zero
+		explicit Vector3(__m128 v) { _mm_store_ps(&x, v); }
+
+		// Load the vector (padding included) in a register
+		__m128 load() const { return _mm_load_ps(&x); }
+#endif
 
 		// Function that flips all the components of the vector
 		void invert() {
+#if defined(CYCLONE_SIMD_SSE)
+			_mm_store_ps(&x, _mm_sub_ps(_mm_setzero_ps(), load()));
+#else
 			x = -x;
 			y = -y;
 			z = -z;
+#endif
 		}
 
 		// Function thet gets the magnitude/length of the vector
@@ -48,57 +71,93 @@ namespace cyclone {
 
 		// Multiplies this vector by the given scalar
 		void operator*=(const real value) {
+#if defined(CYCLONE_SIMD_SSE)
+			_mm_store_ps(&x, _mm_mul_ps(load(), _mm_set1_ps(value)));
+#else
 			x *= value;
 			y *= value;
 			z *= value;
+#endif
 		}
 
 		// Returns a copy of this vector scaled to the given value
 		Vector3 operator*(const real value) const {
+#if defined(CYCLONE_SIMD_SSE)
+			return Vector3(_mm_mul_ps(load(), _mm_set1_ps(value)));
+#else
 			return Vector3(x * value, y * value, z * value);
+#endif
 		}
 
 		// Adds the given vector to this
 		void operator+=(const Vector3& v) {
+#if defined(CYCLONE_SIMD_SSE)
+			_mm_store_ps(&x, _mm_add_ps(load(), v.load()));
+#else
 			x += v.x;
 			y += v.y;
 			z += v.z;
+#endif
 		}
 
 		// Return the value of the given vector added to this
 		Vector3 operator+(const Vector3& v) const {
+#if defined(CYCLONE_SIMD_SSE)
+			return Vector3(_mm_add_ps(load(), v.load()));
+#else
 			return Vector3(x + v.x, y + v.y, z + v.z);
+#endif
 		}
 
 		// Subtracts the given vector from this
 		void operator -=(const Vector3& v) {
+#if defined(CYCLONE_SIMD_SSE)
+			_mm_store_ps(&x, _mm_sub_ps(load(), v.load()));
+#else
 			x -= v.x;
 			y -= v.y;
 			z -= v.z;
+#endif
 		}
 
 		// Return the value of the given vector subtracted from this
 		Vector3 operator -(const Vector3& v) const {
+#if defined(CYCLONE_SIMD_SSE)
+			return Vector3(_mm_sub_ps(load(), v.load()));
+#else
 			return Vector3(x - v.x, y - v.y, z - v.z);
+#endif
 		}
 
 		// Add scaled vector
 		void AddScaledVector(const Vector3& vector, real scale) {
+#if defined(CYCLONE_SIMD_SSE)
+			_mm_store_ps(&x, _mm_add_ps(load(), _mm_mul_ps(vector.load(), _mm_set1_ps(scale))));
+#else
 			x += vector.x * scale;
 			y += vector.y * scale;
 			z += vector.z * scale;
+#endif
 		}
 
 		// Return the result of the componet-wise product of this vector with the given vector
 		Vector3 componentProduct(const Vector3& vector) const {
+#if defined(CYCLONE_SIMD_SSE)
+			return Vector3(_mm_mul_ps(load(), vector.load()));
+#else
 			return Vector3(x * vector.x, y * vector.y, z * vector.z);
+#endif
 		}
 
 		// Compute the result of the componet-wise product in-place
 		void compontProductUpdate(const Vector3& vector) {
+#if defined(CYCLONE_SIMD_SSE)
+			_mm_store_ps(&x, _mm_mul_ps(load(), vector.load()));
+#else
 			x *= vector.x;
 			y *= vector.y;
 			z *= vector.z;
+#endif
 		}
 
 		// Return the scalar product of this vector with the given vector
@@ -113,10 +172,21 @@ namespace cyclone {
 
 		// Return the vector product (cross product) of this vector with the given vector
 		Vector3 VectorProduct(const Vector3& vector) const {
+#if defined(CYCLONE_SIMD_SSE)
+			// (y, z, x) * (v.z, v.x, v.y) - (z, x, y) * (v.y, v.z, v.x)
+			__m128 a = load();
+			__m128 b = vector.load();
+			__m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+			__m128 aZXY = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+			__m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+			__m128 bZXY = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+			return Vector3(_mm_sub_ps(_mm_mul_ps(aYZX, bZXY), _mm_mul_ps(aZXY, bYZX)));
+#else
 			return Vector3(
 				y * vector.z - z * vector.y,
 				z * vector.x - x * vector.z,
 				x * vector.y - y * vector.x);
+#endif
 		}
 
 		// Vector product overload in-place
@@ -126,10 +196,7 @@ namespace cyclone {
 
 		// Vector product overload
 		Vector3 operator%(const Vector3& vector) const {
-			return Vector3(
-				y * vector.z - z * vector.y,
-				z * vector.x - x * vector.z,
-				x * vector.y - y * vector.x);
+			return VectorProduct(vector);
 		}
 
 		// Zero the components values
@@ -140,6 +207,9 @@ namespace cyclone {
 		}
 	};
 
+	// Normalize count vectors in-place, zero vectors are left untouched
+	void normalizeVectors(Vector3* vectors, unsigned count);
+
 	class Quaternion {
 	public:
 		union {
@@ -177,7 +247,7 @@ namespace cyclone {
 			Quaternion q = *this;
 
 			r = q.r * multiplier.r - q.i * multiplier.i - q.j * multiplier.j - q.k * multiplier.k;
-			i = q.r * multiplier.i - q.i * multiplier.r + q.j * multiplier.k - q.k * multiplier.j;
+			i = q.r * multiplier.i + q.i * multiplier.r + q.j * multiplier.k - q.k * multiplier.j;
 			j = q.r * multiplier.j + q.j * multiplier.r + q.k * multiplier.i - q.i * multiplier.k;
 			k = q.r * multiplier.k + q.k * multiplier.r + q.i * multiplier.j - q.j * multiplier.i;
 		}
@@ -220,6 +290,28 @@ namespace cyclone {
 			data[6] = c6; data[7] = c7; data[8] = c8;
 		}
 
+		// Transform the given vector by this matrix
+		Vector3 operator*(const Vector3& vector) const {
+			return Vector3(
+				vector.x * data[0] + vector.y * data[1] + vector.z * data[2],
+				vector.x * data[3] + vector.y * data[4] + vector.z * data[5],
+				vector.x * data[6] + vector.y * data[7] + vector.z * data[8]
+			);
+		}
+
+		Vector3 transform(const Vector3& vector) const {
+			return (*this) * vector;
+		}
+
+		// Transform the given vector by the transpose of this matrix
+		Vector3 transformTranspose(const Vector3& vector) const {
+			return Vector3(
+				vector.x * data[0] + vector.y * data[3] + vector.z * data[6],
+				vector.x * data[1] + vector.y * data[4] + vector.z * data[7],
+				vector.x * data[2] + vector.y * data[5] + vector.z * data[8]
+			);
+		}
+
 		Matrix3 operator*(const Matrix3& o) const {
 			return Matrix3(
 				data[0] * o.data[0] + data[1] * o.data[3] + data[2] * o.data[6],
@@ -320,16 +412,75 @@ namespace cyclone {
 			data[0] = data[5] = data[10] = 1;
 		}
 
+#if defined(CYCLONE_SIMD_SSE)
+		// Load the rows of the rotation, that are the columns of the inverse rotation, with the last lane zeroed
+		void loadInverseColumns(__m128* columns) const {
+			__m128 mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+			columns[0] = _mm_and_ps(_mm_loadu_ps(data), mask);
+			columns[1] = _mm_and_ps(_mm_loadu_ps(data + 4), mask);
+			columns[2] = _mm_and_ps(_mm_loadu_ps(data + 8), mask);
+		}
+
+		// Load the four columns of the matrix, the last lane of each column is zero
+		void loadColumns(__m128* columns) const {
+			__m128 r0 = _mm_loadu_ps(data);
+			__m128 r1 = _mm_loadu_ps(data + 4);
+			__m128 r2 = _mm_loadu_ps(data + 8);
+			__m128 r3 = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			columns[0] = r0;
+			columns[1] = r1;
+			columns[2] = r2;
+			columns[3] = r3;
+		}
+#endif
+
 		Vector3 operator*(const Vector3& vector) const {
+#if defined(CYCLONE_SIMD_SSE)
+			__m128 c[4];
+			loadColumns(c);
+			__m128 v = vector.load();
+			__m128 result = _mm_mul_ps(c[0], _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+			result = _mm_add_ps(result, _mm_mul_ps(c[1], _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+			result = _mm_add_ps(result, _mm_mul_ps(c[2], _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+			return Vector3(_mm_add_ps(result, c[3]));
+#else
 			return Vector3(
 				vector.x * data[0] + vector.y * data[1] + vector.z * data[2] + data[3],
 				vector.x * data[4] + vector.y * data[5] + vector.z * data[6] + data[7],
 				vector.x * data[8] + vector.y * data[9] + vector.z * data[10] + data[11]
 			);
+#endif
 		}
 
+		Vector3 transform(const Vector3& vector) const {
+			return (*this) * vector;
+		}
+
+		// Batch versions of operator*, transformDirection, transformInverse and transformInverseDirection.
+		// They give the same results as the single vector functions, the matrix is loaded (and the
+		// rotation transposed for the inverse ones) once per call. out may be the same buffer as in
+		void transformPoints(const Vector3* in, Vector3* out, unsigned count) const;
+		void transformDirections(const Vector3* in, Vector3* out, unsigned count) const;
+		void transformInversePoints(const Vector3* in, Vector3* out, unsigned count) const;
+		void transformInverseDirections(const Vector3* in, Vector3* out, unsigned count) const;
+
 		Matrix4 operator*(const Matrix4& o) const {
 			Matrix4 result;
+#if defined(CYCLONE_SIMD_SSE)
+			// Each row of the result is a combination of the rows of o
+			__m128 o0 = _mm_loadu_ps(o.data);
+			__m128 o1 = _mm_loadu_ps(o.data + 4);
+			__m128 o2 = _mm_loadu_ps(o.data + 8);
+			for (unsigned row = 0; row < 12; row += 4) {
+				__m128 r = _mm_mul_ps(o0, _mm_set1_ps(data[row]));
+				r = _mm_add_ps(r, _mm_mul_ps(o1, _mm_set1_ps(data[row + 1])));
+				r = _mm_add_ps(r, _mm_mul_ps(o2, _mm_set1_ps(data[row + 2])));
+				r = _mm_add_ps(r, _mm_set_ps(data[row + 3], 0, 0, 0));
+				_mm_storeu_ps(result.data + row, r);
+			}
+			return result;
+#else
 
 			result.data[0] = (o.data[0] * data[0]) + (o.data[4] * data[1]) + (o.data[8] * data[2]);
 			result.data[4] = (o.data[0] * data[4]) + (o.data[4] * data[5]) + (o.data[8] * data[6]);
@@ -348,6 +499,7 @@ namespace cyclone {
 			result.data[11] = (o.data[3] * data[8]) + (o.data[7] * data[9]) + (o.data[11] * data[10]) + data[11];
 
 			return result;
+#endif
 		}
 
 		real getDeterminant() const;
@@ -366,6 +518,16 @@ namespace cyclone {
 
 		Vector3 transformInverse(const Vector3& vector) const
 		{
+#if defined(CYCLONE_SIMD_SSE)
+			// The inverse rotation is the transpose, so the rows of the matrix are the columns we need
+			__m128 r[3];
+			loadInverseColumns(r);
+			__m128 v = _mm_sub_ps(vector.load(), _mm_set_ps(0, data[11], data[7], data[3]));
+			__m128 result = _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)), r[0]);
+			result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)), r[1]));
+			result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)), r[2]));
+			return Vector3(result);
+#else
 			Vector3 tmp = vector;
 			tmp.x -= data[3];
 			tmp.y -= data[7];
@@ -383,10 +545,20 @@ namespace cyclone {
 				tmp.y * data[6] +
 				tmp.z * data[10]
 			);
+#endif
 		}
 
 		Vector3 transformDirection(const Vector3& vector) const
 		{
+#if defined(CYCLONE_SIMD_SSE)
+			__m128 c[4];
+			loadColumns(c);
+			__m128 v = vector.load();
+			__m128 result = _mm_mul_ps(c[0], _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+			result = _mm_add_ps(result, _mm_mul_ps(c[1], _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+			result = _mm_add_ps(result, _mm_mul_ps(c[2], _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+			return Vector3(result);
+#else
 			return Vector3(
 				vector.x * data[0] +
 				vector.y * data[1] +
@@ -400,6 +572,35 @@ namespace cyclone {
 				vector.y * data[9] +
 				vector.z * data[10]
 			);
+#endif
+		}
+
+		// Transform a direction by the inverse rotation, ignoring the translation
+		Vector3 transformInverseDirection(const Vector3& vector) const
+		{
+#if defined(CYCLONE_SIMD_SSE)
+			__m128 r[3];
+			loadInverseColumns(r);
+			__m128 v = vector.load();
+			__m128 result = _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)), r[0]);
+			result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)), r[1]));
+			result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)), r[2]));
+			return Vector3(result);
+#else
+			return Vector3(
+				vector.x * data[0] +
+				vector.y * data[4] +
+				vector.z * data[8],
+
+				vector.x * data[1] +
+				vector.y * data[5] +
+				vector.z * data[9],
+
+				vector.x * data[2] +
+				vector.y * data[6] +
+				vector.z * data[10]
+			);
+#endif
 		}
 
 		void setorientationAndPos(const Quaternion& q, const Vector3& pos) {
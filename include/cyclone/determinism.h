@@ -0,0 +1,44 @@
+#ifndef CYCLONE_DETERMINISM_H
+#define CYCLONE_DETERMINISM_H
+
+#include <cstddef>
+#include <vector>
+
+namespace cyclone {
+
+	// Power function made of additions, multiplications and divisions only, which IEEE 754 rounds the
+	// same way on every machine, unlike the libm pow whose last bit depends on the library version.
+	// Used as real_pow in deterministic builds (CMake option CYCLONE_DETERMINISTIC). The base must not
+	// be negative
+	double deterministicPow(double base, double exponent);
+
+	// Streaming 64 bit hash of raw memory, for cheap desync detection between lockstep peers. Data can be
+	// added in any number of pieces, the result only depends on the concatenated bytes. Floating point
+	// values are hashed bit for bit, so 0.0 and -0.0 differ
+	class StateHash {
+	protected:
+		unsigned long long lanes[4]; // Four independent accumulators, 32 bytes per round
+		unsigned char buffer[32]; // Bytes waiting for a full round
+		unsigned bufferSize;
+		unsigned long long length;
+
+		void round(const unsigned char* data);
+
+	public:
+		StateHash(unsigned long long seed = 0);
+
+		// Hash the given bytes
+		void add(const void* data, size_t size);
+
+		// Hash the contents of a vector
+		template<class T>
+		void add(const std::vector<T>& values) {
+			add(values.data(), values.size() * sizeof(T));
+		}
+
+		// Hash of all the bytes added so far. More data can still be added afterwards
+		unsigned long long get() const;
+	};
+}
+
+#endif// CYCLONE_DETERMINISM_H
\ No newline at end of file
@@ -0,0 +1,80 @@
+#ifndef CYCLONE_JOBS_H
+#define CYCLONE_JOBS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cyclone {
+
+	// Small job system: a pool of worker threads, each with its own deque of tasks. A worker pops
+	// its newest task first and steals the oldest task of another worker when it runs out of work
+	class JobSystem {
+	public:
+		// Job processing the items in the range [begin, end)
+		typedef std::function<void(unsigned begin, unsigned end)> RangeJob;
+
+	protected:
+		// Counts the tasks of a parallelFor still to complete
+		struct Batch {
+			std::atomic<unsigned> remaining;
+		};
+
+		struct Task {
+			const RangeJob* job;
+			unsigned begin;
+			unsigned end;
+			Batch* batch;
+		};
+
+		// Deque of tasks of a thread, protected by its own mutex
+		struct Queue {
+			std::mutex mutex;
+			std::deque<Task> tasks;
+		};
+
+		// One queue per worker plus one for the threads outside the pool
+		std::vector<Queue*> queues;
+		std::vector<std::thread> workers;
+
+		// Used to put idle workers to sleep
+		std::mutex sleepMutex;
+		std::condition_variable wakeUp;
+		std::atomic<unsigned> queuedTasks;
+		bool stopping;
+
+		// Worker main loop
+		void workerLoop(unsigned queueIndex);
+
+		// Pop a task from the given queue or steal one from the others
+		bool findTask(unsigned queueIndex, Task& task);
+
+		// Run a task and signal its batch
+		void runTask(const Task& task);
+
+		// Queue of the calling thread
+		unsigned getQueueIndex() const;
+
+	public:
+		// Create the pool. With threadCount 0 one thread per hardware core is used, the thread
+		// calling parallelFor counts as one of them
+		JobSystem(unsigned threadCount = 0);
+		~JobSystem();
+
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+
+		// Number of threads running jobs, the calling thread included
+		unsigned getThreadCount() const { return (unsigned)workers.size() + 1; }
+
+		// Split [0, count) in ranges of at most grain items and run the job on them in parallel.
+		// Returns when all the ranges are done, the calling thread works on them meanwhile
+		void parallelFor(unsigned count, unsigned grain, const RangeJob& job);
+	};
+}
+
+#endif// CYCLONE_JOBS_H
\ No newline at end of file
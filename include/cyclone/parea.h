@@ -0,0 +1,121 @@
+#ifndef CYCLONE_PAREA_H
+#define CYCLONE_PAREA_H
+
+#include <vector>
+
+#include "precision.h"
+#include "core.h"
+#include "jobs.h"
+#include "pquery.h"
+#include "pstore.h"
+
+namespace cyclone {
+
+	// Force acting on the particles inside a volume of space. Unlike a force generator it has no
+	// registrations: at each force update the particles inside its bounding sphere are found through a
+	// ParticleQuery and only those are touched, so a small effect costs the same in a world of any
+	// size. Particles receiving a force are woken up
+	class ParticleAreaForce {
+	protected:
+		// Particles inside the bounds, found by the last apply. Kept at the largest size needed so far
+		std::vector<unsigned> reached;
+
+	public:
+		virtual ~ParticleAreaForce() {}
+
+		// Bounding sphere of the volume where the force currently acts, false when it acts nowhere
+		virtual bool getBounds(ParticleSphere& bounds) const = 0;
+
+		// Add the force to the given particles of the store, the ones inside the bounds. Particles
+		// outside the volume itself must be skipped
+		virtual void updateForces(ParticleStore* store, const unsigned* indices, unsigned count, real duration) = 0;
+
+		// Move the effect forward in time, once per step after the integration
+		virtual void advance(real duration) {}
+
+		// Find the particles inside the bounds with the query, or by testing all the particles of the
+		// store without one, and add the force to them. The particles are split over the job system if any
+		void apply(ParticleStore* store, const ParticleQuery* query, real duration, JobSystem* jobs);
+	};
+
+	// Explosion in three phases, as designed in the book. The times are counted from the detonation,
+	// which is when the explosion is created or restarted
+	class ParticleExplosion : public ParticleAreaForce {
+	public:
+		Vector3 detonation;
+
+		// Implosion: for implosionDuration the particles between the min and max radius are pulled
+		// towards the detonation
+		real implosionMaxRadius;
+		real implosionMinRadius;
+		real implosionDuration;
+		real implosionForce;
+
+		// Concussion: then a shell of the given half thickness moves out at shockwaveSpeed and pushes
+		// the particles it passes, the most at its middle. The force fades to zero over concussionDuration
+		real shockwaveSpeed;
+		real shockwaveThickness;
+		real peakConcussionForce;
+		real concussionDuration;
+
+		// Convection: at the same time hot air rising in a vertical chimney above the detonation lifts
+		// the particles, the most on its axis. The force fades to zero over convectionDuration
+		real peakConvectionForce;
+		real chimneyRadius;
+		real chimneyHeight;
+		real convectionDuration;
+
+	protected:
+		real time; // Since the detonation
+
+	public:
+		// An explosion with every parameter at zero, to be set before the first step
+		ParticleExplosion(const Vector3& detonation);
+
+		// Detonate again, at the same point
+		void restart() { time = 0; }
+
+		real getTime() const { return time; }
+
+		// True once all the phases are over
+		bool isFinished() const;
+
+		virtual bool getBounds(ParticleSphere& bounds) const;
+		virtual void updateForces(ParticleStore* store, const unsigned* indices, unsigned count, real duration);
+		virtual void advance(real duration) { time += duration; }
+	};
+
+	// Wind blowing inside a sphere. Particles are dragged towards the velocity of the wind, with a
+	// force proportional to their velocity relative to it
+	class ParticleWind : public ParticleAreaForce {
+	public:
+		Vector3 centre;
+		real radius;
+		Vector3 velocity;
+		real dragCoefficient;
+
+		ParticleWind(const Vector3& centre, real radius, const Vector3& velocity, real dragCoefficient);
+
+		virtual bool getBounds(ParticleSphere& bounds) const;
+		virtual void updateForces(ParticleStore* store, const unsigned* indices, unsigned count, real duration);
+	};
+
+	// Vortex inside a sphere, turning around an axis through its centre. Particles are pushed around the
+	// axis, pulled towards it and lifted along it. The forces fade to zero at the radius
+	class ParticleVortex : public ParticleAreaForce {
+	public:
+		Vector3 centre;
+		Vector3 axis; // Unit length, the particles turn counterclockwise seen from its tip
+		real radius;
+		real tangentialForce;
+		real inwardForce;
+		real liftForce;
+
+		ParticleVortex(const Vector3& centre, const Vector3& axis, real radius, real tangentialForce, real inwardForce, real liftForce);
+
+		virtual bool getBounds(ParticleSphere& bounds) const;
+		virtual void updateForces(ParticleStore* store, const unsigned* indices, unsigned count, real duration);
+	};
+}
+
+#endif// CYCLONE_PAREA_H
\ No newline at end of file
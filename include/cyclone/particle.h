@@ -5,43 +5,97 @@
 #include "precision.h"
 
 namespace cyclone {
+	class ParticleStore;
+
 	class Particle {
+		friend class ParticleStore;
 	protected:
 		Vector3 position;
 		Vector3 velocity;
 		Vector3 acceleration;
 		real inverseMass;
-		real damping; // Holds the amount of damping applied to linear motion
+		real damping; // Holds the amount of damping applied to linear motion, for handles the one of the cached factors
+		real dampingFactor; // Cached real_pow(damping, dampingDuration)
+		real sleepBias; // Cached real_pow(0.5, dampingDuration), weight of the previous motion in the average
+		real dampingDuration; // Duration of the cached factors, zero when they must be recomputed
 		Vector3 forceAccum; // Holds the accumulated force to be applied at the next simulation iteration
+
+		real motion; // Low-pass filtered kinetic energy per unit mass, used to decide when to sleep
+		bool isAwake; // Sleeping particles are skipped by integration and force generators
+		bool canSleep; // Some particles may never sleep (e.g. user controlled ones)
+
+		// Store holding the data of this particle, or null for a standalone particle
+		ParticleStore* store;
+		unsigned index; // Index of the particle data inside the store
 	public:
+		Particle();
+
 		void setMass(const real mass);
 		real getMass() const;
-		
+
 		void setInverseMass(const real inverseMass);
 		real getInverseMass() const;
 
+		void setDamping(const real damping);
+		real getDamping() const;
+
 		// Integrate the particle forward in time (Newton-Euler integration)
 		void integrate(real duration);
 
 		// Cleat the forces applied to the particles
 		void clearAccumulator();
 
-		// Add force to the particle
+		// Add force to the particle, waking it up
 		void addForce(const Vector3& force);
 
 		// Return true if the mass is not infinite
 		bool hasFiniteMass() const;
 
+		// Set position
+		void setPosition(const Vector3& position);
+
 		// Get position
 		void getPosition(Vector3* position) const;
 
 		Vector3 getPosition() const;
 
+		// Move the particle by the given offset. Particles of a store are moved in the precision of
+		// its positions, where setPosition(getPosition() + offset) would round them to real
+		void translate(const Vector3& offset);
+
+		// Position of this particle relative to the other one. For two particles of the same store
+		// the difference is taken in the precision of the positions
+		Vector3 getSeparation(const Particle& other) const;
+
+		// Set velocity
+		void setVelocity(const Vector3& velocity);
+
 		// Get velocity of the particle in-place
 		void getVelocity(Vector3* velocity) const;
 
 		// Get velocity of the particle
 		Vector3 getVelocity() const;
+
+		// Set the constant acceleration (e.g. gravity) of the particle
+		void setAcceleration(const Vector3& acceleration);
+
+		// Get the constant acceleration of the particle
+		Vector3 getAcceleration() const;
+
+		// Sleeping state. Putting a particle to sleep zeroes its velocity, waking it up gives it
+		// some motion so it does not fall asleep again immediately
+		bool getAwake() const;
+		void setAwake(const bool awake = true);
+
+		// Allow the particle to sleep when it has been at rest for a while, off by default
+		bool getCanSleep() const;
+		void setCanSleep(const bool canSleep = true);
+
+		// Return the store the particle lives in (null for standalone particles)
+		ParticleStore* getStore() const { return store; }
+
+		// Return the index of the particle inside its store
+		unsigned getIndex() const { return index; }
 	};
 }
 
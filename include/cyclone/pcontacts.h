@@ -0,0 +1,75 @@
+#ifndef CYCLONE_PCONTACTS_H
+#define CYCLONE_PCONTACTS_H
+
+#include "precision.h"
+#include "particle.h"
+
+namespace cyclone {
+	class ParticleContactResolver;
+
+	// A contact between two particles, or between a particle and the scenery (second particle null).
+	// Resolving a contact removes the interpenetration and applies an impulse to separate the particles
+	class ParticleContact {
+		friend class ParticleContactResolver;
+
+	public:
+		Particle* particle[2]; // Particles involved in the contact, the second is null for scenery
+		real restitution; // Normal restitution coefficient at the contact
+		Vector3 contactNormal; // Direction of the contact in world coordinates, from the first particle point of view
+		real penetration; // Depth of penetration at the contact
+
+		// Amount each particle is moved by the interpenetration resolution
+		Vector3 particleMovement[2];
+
+	protected:
+		// Resolve the contact, both for velocity and interpenetration
+		void resolve(real duration);
+
+		// Separating velocity at this contact
+		real calculateSeparatingVelocity() const;
+
+	private:
+		// Impulse calculations for this contact
+		void resolveVelocity(real duration);
+
+		// Interpenetration resolution for this contact
+		void resolveInterpenetration(real duration);
+	};
+
+	// Contact resolution routine for particle contacts, one instance can be shared by the whole simulation.
+	// Velocities are resolved first then interpenetrations, each phase picking the worst contact at every
+	// iteration. After a resolution only the contacts sharing a particle with it are updated, the worst one
+	// is then taken from a heap instead of scanning the whole list again.
+	// Sleeping particles in contact with awake ones are woken up before the resolution
+	class ParticleContactResolver {
+	protected:
+		unsigned velocityIterations; // Max number of velocity resolutions
+		unsigned positionIterations; // Max number of interpenetration resolutions
+		unsigned iterationsUsed; // Number of resolutions performed by the last call
+
+	public:
+		ParticleContactResolver(unsigned iterations);
+
+		// Use the same budget for velocity and interpenetration resolution
+		void setIterations(unsigned iterations);
+
+		void setIterations(unsigned velocityIterations, unsigned positionIterations);
+
+		// Number of resolutions performed by the last resolveContacts call
+		unsigned getIterationsUsed() const { return iterationsUsed; }
+
+		// Resolve a set of particle contacts for both penetration and velocity
+		void resolveContacts(ParticleContact* contactArray, unsigned numContacts, real duration);
+	};
+
+	// Interface for the contact generators applying to particles
+	class ParticleContactGenerator {
+	public:
+		// Fill the given contact structure with the generated contacts. The pointer points to the first
+		// available contact and limit is the number of contacts that can be written.
+		// Return the number of contacts written
+		virtual unsigned addContact(ParticleContact* contact, unsigned limit) const = 0;
+	};
+}
+
+#endif// CYCLONE_PCONTACTS_H
\ No newline at end of file
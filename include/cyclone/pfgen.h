@@ -1,43 +1,158 @@
 #ifndef PFGEN_H
 #define	PFGEN_H
 
+#include <unordered_map>
 #include <vector>
 
 #include "precision.h"
 #include "particle.h"
+#include "pool.h"
 
 namespace cyclone {
+	class JobSystem;
+	class ParticleStore;
 
+	// Generators may read any particle but must add forces only to the particle they are given,
+	// this is what allows the registry to update the forces of different particles in parallel
 	class ParticleForceGenerator {
 	public:
 		virtual void updateForce(Particle* particle, real duration) = 0;
+
+		// Apply the force to each of the given particles. Overrides must give the same forces as
+		// calling updateForce on each particle in turn
+		virtual void updateForces(Particle* const* particles, size_t count, real duration);
+
+		// Apply the force to the awake particles of the store in the range [begin, end), the entry point
+		// of the world force fields. Overrides work on the store arrays directly
+		virtual void updateForces(ParticleStore* store, unsigned begin, unsigned end, real duration);
 	};
 
 	// Holds all the force generators and the particles they apply to
 	class ParticleForceRegistry {
+	public:
+		// Identifies a registration. The generation makes handles of removed registrations
+		// invalid even when their slot is reused
+		struct Handle {
+			unsigned slot;
+			unsigned generation;
+		};
+
 	protected:
 		// Keeps track of one force generator and the particle it applies to
 		struct ParticleForceRegistration {
 			Particle* particle;
 			ParticleForceGenerator* fg;
+			unsigned slot; // Slot of the handle owning the registration
 		};
 
 		// Golds the list of registrations
 		typedef std::vector<ParticleForceRegistration> Registry;
-		Registry registrations;
-	
+
+		// In bucketed mode the built-in generators are grouped by concrete type, each group is
+		// dispatched by a statically typed loop. Every other generator goes in the generic bucket
+		// and is called through the virtual updateForce
+		enum Bucket {
+			BUCKET_GRAVITY,
+			BUCKET_DRAG,
+			BUCKET_SPRING,
+			BUCKET_ANCHORED_SPRING,
+			BUCKET_BUNGEE,
+			BUCKET_BUOYANCY,
+			BUCKET_GENERIC,
+			BUCKET_COUNT
+		};
+		Registry registrations[BUCKET_COUNT];
+
+		bool bucketed;
+
+		// Sparse index from handles to registrations, also chaining the registrations of each particle
+		struct Slot {
+			unsigned generation;
+			unsigned bucket;
+			unsigned position; // Position in the bucket, or next free slot when unused
+			unsigned prevForParticle;
+			unsigned nextForParticle;
+		};
+		std::vector<Slot> slots;
+		unsigned firstFreeSlot;
+
+		// First slot of the registrations of each particle. The map nodes come from a pool, so adding and
+		// removing registrations does not allocate once the registry has reached its working size
+		NodePool chainNodes;
+		typedef std::unordered_map<Particle*, unsigned, std::hash<Particle*>, std::equal_to<Particle*>,
+			PoolAllocator<std::pair<Particle* const, unsigned>>> ParticleChains;
+		ParticleChains particleChains;
+
+		// Remove the registration held by a valid slot
+		void removeSlot(unsigned slot);
+
+		// Registrations grouped by particle for the parallel update, each group keeps the serial order
+		struct ParallelEntry {
+			unsigned bucket;
+			unsigned position;
+		};
+		std::vector<ParallelEntry> parallelEntries;
+		std::vector<unsigned> parallelGroups; // First entry of each group, followed by the entry count
+		bool parallelDirty; // Set when the registrations change
+
+		// Rebuild the groups used by the parallel update
+		void buildParallelGroups();
+
+		// Apply a single registration of the given bucket
+		static void applyRegistration(unsigned bucket, ParticleForceRegistration& registration, real duration);
+
+		// Bucket receiving the given generator
+		Bucket getBucket(ParticleForceGenerator* fg) const;
+
+		// Apply a bucket of generators all of the given concrete type
+		template<class Generator>
+		void updateBucket(unsigned bucket, real duration);
+
+		// Awake particles of a run of registrations sharing a generator
+		std::vector<Particle*> batch;
+
 	public:
+		// Create a registry, optionally in bucketed mode
+		ParticleForceRegistry(bool bucketed = false);
+
+		// Enable or disable the bucketed mode. In bucketed mode the registrations are applied
+		// bucket by bucket, so generators of different types are no more called in insertion order
+		void setBucketed(bool bucketed);
+		bool isBucketed() const { return bucketed; }
+
 		// Register force generator to apply ti the given particle
-		void add(Particle* particle, ParticleForceGenerator* fg);
+		Handle add(Particle* particle, ParticleForceGenerator* fg);
+
+		// Remove a registration in constant time. The last registration of the bucket takes its
+		// place, so the order of the remaining registrations may change
+		void remove(Handle handle);
 
 		// Remove force generator
 		void remove(Particle* particle, ParticleForceGenerator* fg);
 
+		// Remove all the registrations of a particle, in time proportional to their number
+		void removeAllFor(Particle* particle);
+
+		// Return true if the handle refers to a registration still in the registry
+		bool isValid(Handle handle) const;
+
+		// Number of registrations
+		unsigned size() const;
+
+		// Append all the registrations in the order updateForces applies them. Adding them back in that
+		// order to an empty registry in the same mode gives the same update
+		void getRegistrations(std::vector<Particle*>& particles, std::vector<ParticleForceGenerator*>& generators) const;
+
 		// Crears all registrations
 		void clear();
 
-		// Calls the force generators to update the forces
+		// Calls the force generators to update the forces. Sleeping particles are skipped, so the
+		// generators do not wake them up
 		void updateForces(real duration);
+
+		// Calls the force generators in parallel. The registrations of a particle all run on the same
+		// thread and in the same order as updateForces(duration), so the result is bit-for-bit identical
+		void updateForces(real duration, JobSystem& jobs);
 	};
 
 	// Force generator that apply gravity to particles
@@ -46,6 +161,10 @@ namespace cyclone {
 	public:
 		ParticleGravity(const Vector3& gravity);
 		virtual void updateForce(Particle* particle, real duration);
+		virtual void updateForces(Particle* const* particles, size_t count, real duration);
+
+		// Single pass over the store with the cached masses, no division
+		virtual void updateForces(ParticleStore* store, unsigned begin, unsigned end, real duration);
 	};
 
 	// Particle generator that apply drag
@@ -56,7 +175,11 @@ namespace cyclone {
 	public:
 		ParticleDrag(real k1, real k2);
 		virtual void updateForce(Particle* particle, real duration);
+		virtual void updateForces(Particle* const* particles, size_t count, real duration);
 
+		// Single pass over the store computing the force as -v (k1 + k2 |v|), which saves the
+		// normalization. Same forces as updateForce up to rounding
+		virtual void updateForces(ParticleStore* store, unsigned begin, unsigned end, real duration);
 	};
 
 	// Force generator that applies a spring force
@@ -82,7 +205,7 @@ namespace cyclone {
 	};
 
 	// Force generator that applies a bungee force
-	class ParticleBungee : ParticleForceGenerator {
+	class ParticleBungee : public ParticleForceGenerator {
 		Particle* other; // Particle at the other end of the spring
 		real springConstant;
 		real restLength;
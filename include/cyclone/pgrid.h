@@ -0,0 +1,130 @@
+#ifndef CYCLONE_PGRID_H
+#define CYCLONE_PGRID_H
+
+#include <vector>
+
+#include "precision.h"
+#include "pcontacts.h"
+#include "pstore.h"
+
+namespace cyclone {
+
+	// Candidate pair of particles found by the broadphase, as indices in the positions given to the grid
+	struct ParticlePair {
+		unsigned first;
+		unsigned second;
+	};
+
+	// Uniform grid broadphase. Cells are hashed into a table and the particles are counting-sorted by
+	// hash bucket into a single flat array, so rebuilding the grid allocates nothing once warmed up
+	class ParticleGrid {
+	protected:
+		real cellSize;
+		real inverseCellSize;
+
+		// Hash table: entries of bucket b are sortedIndices[bucketStart[b] .. bucketStart[b + 1])
+		unsigned bucketMask;
+		std::vector<unsigned> bucketStart;
+		std::vector<unsigned> sortedIndices;
+
+		// Cell of each sorted entry, to tell apart the cells sharing a bucket
+		std::vector<int> sortedCellX, sortedCellY, sortedCellZ;
+
+		// Cell and bucket of each particle, in particle order
+		std::vector<int> cellX, cellY, cellZ;
+		std::vector<unsigned> bucketOf;
+
+		// Bucket of a cell
+		unsigned getBucket(int x, int y, int z) const {
+			unsigned h = ((unsigned)x * 73856093u) ^ ((unsigned)y * 19349663u) ^ ((unsigned)z * 83492791u);
+			return h & bucketMask;
+		}
+
+	public:
+		// The cell size should be at least the interaction distance, e.g. twice the particle radius
+		ParticleGrid(real cellSize);
+
+		void setCellSize(real cellSize);
+		real getCellSize() const { return cellSize; }
+
+		// Rebuild the grid from the given positions
+		void build(const position_real* x, const position_real* y, const position_real* z, unsigned count);
+
+		// Rebuild the grid from the positions of a store
+		void build(const ParticleStore& store);
+
+		// Number of particles in the grid
+		unsigned size() const { return (unsigned)bucketOf.size(); }
+
+		// Cell coordinate of a position component
+		int getCell(position_real value) const;
+
+		// Call visit(index) for each particle in the given cell
+		template<class Visitor>
+		void forEachInCell(int x, int y, int z, Visitor visit) const {
+			if (bucketOf.empty()) {
+				return;
+			}
+			unsigned bucket = getBucket(x, y, z);
+			for (unsigned entry = bucketStart[bucket]; entry < bucketStart[bucket + 1]; ++entry) {
+				if (sortedCellX[entry] == x && sortedCellY[entry] == y && sortedCellZ[entry] == z) {
+					visit(sortedIndices[entry]);
+				}
+			}
+		}
+
+		// Call visit(index) for each particle in the cells from (minX, minY, minZ) to (maxX, maxY, maxZ)
+		// included. A box with few cells for the number of particles looks up its cells, a larger one
+		// tests the cell of every particle instead, so the cost never goes beyond one pass over them
+		template<class Visitor>
+		void forEachInBox(int minX, int minY, int minZ, int maxX, int maxY, int maxZ, Visitor visit) const {
+			if (bucketOf.empty() || minX > maxX || minY > maxY || minZ > maxZ) {
+				return;
+			}
+			// A cell lookup hashes and scans a bucket, several times the cost of testing a particle
+			double cells = ((double)maxX - minX + 1) * ((double)maxY - minY + 1) * ((double)maxZ - minZ + 1);
+			if (cells * 4 <= (double)size()) {
+				for (int x = minX; x <= maxX; ++x) {
+					for (int y = minY; y <= maxY; ++y) {
+						for (int z = minZ; z <= maxZ; ++z) {
+							forEachInCell(x, y, z, visit);
+						}
+					}
+				}
+				return;
+			}
+
+			// In particle order, so the visitor reads the particle data sequentially
+			unsigned count = size();
+			for (unsigned i = 0; i < count; ++i) {
+				if (cellX[i] >= minX && cellX[i] <= maxX && cellY[i] >= minY && cellY[i] <= maxY && cellZ[i] >= minZ && cellZ[i] <= maxZ) {
+					visit(i);
+				}
+			}
+		}
+
+		// Append to pairs every pair of particles lying in the same or in adjacent cells.
+		// Each pair is reported once, with no guarantee that the particles actually touch
+		void findPairs(std::vector<ParticlePair>& pairs) const;
+	};
+
+	// Generates the contacts between the particles of a store colliding as spheres of the same radius,
+	// using a ParticleGrid to avoid testing all the pairs
+	class ParticleCollisions : public ParticleContactGenerator {
+	protected:
+		ParticleStore* store;
+		real radius;
+		real restitution;
+
+		// Broadphase data, rebuilt at each call
+		mutable ParticleGrid grid;
+		mutable std::vector<ParticlePair> pairs;
+
+	public:
+		ParticleCollisions(ParticleStore* store, real radius, real restitution);
+
+		virtual unsigned addContact(ParticleContact* contact, unsigned limit) const;
+	};
+}
+
+#endif// CYCLONE_PGRID_H
\ No newline at end of file
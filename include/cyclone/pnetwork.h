@@ -0,0 +1,86 @@
+#ifndef CYCLONE_PNETWORK_H
+#define CYCLONE_PNETWORK_H
+
+#include <vector>
+
+#include "precision.h"
+#include "particle.h"
+#include "pstore.h"
+
+namespace cyclone {
+
+	// Network of springs between the particles of a store, advanced with implicit (backward) Euler.
+	// Each step solves (M - h^2 K) dv = h (f + h K v) with a matrix-free preconditioned conjugate gradient,
+	// K being the stiffness matrix of the springs, then adds to the particles the force that makes the
+	// integrator give them the velocity change dv. Stiff networks (cloth, soft bodies) stay stable with
+	// steps far larger than the same springs made of ParticleSpring generators.
+	//
+	// Unlike ParticleSpring the links are Hookean both ways: they pull when stretched and push when
+	// compressed. Particles with infinite mass and sleeping particles are kept fixed. The network should
+	// be updated after the other force generators (ParticleWorld does it), so their forces are part of f,
+	// and gives the backward Euler result exactly with the symplectic Euler integrator.
+	class ParticleSpringNetwork {
+	protected:
+		// A spring between two particles, same parameters as ParticleSpring
+		struct Link {
+			Particle* particle[2];
+			real springConstant;
+			real restLength;
+		};
+		std::vector<Link> links;
+
+		ParticleStore* store;
+
+		unsigned maxIterations;
+		real tolerance;
+		unsigned iterationsUsed;
+
+		// Solver data, rebuilt at each update. Unknowns are numbered by first appearance in the links
+		std::vector<unsigned> unknownOf; // Unknown of each store index, or NO_UNKNOWN
+		std::vector<unsigned> storeIndex; // Store index of each unknown
+		std::vector<unsigned> linkUnknowns; // Pairs of unknowns of each link
+		std::vector<real> inverseMass;
+		std::vector<unsigned char> fixed;
+
+		// Stiffness of each link, the block is stiffnessI * I + stiffnessU * u u^T (scaled by h^2)
+		std::vector<real> stiffnessI, stiffnessU;
+		std::vector<real> directionX, directionY, directionZ;
+
+		// Conjugate gradient vectors, three components per unknown
+		std::vector<real> deltaV; // Solution, kept to warm start the next update
+		std::vector<real> rightHandSide, residual, search, product, preconditioned, diagonal;
+		bool warmStart; // False when the unknowns changed since the last update
+
+		// product = A * vector, where A = M - h^2 K
+		void multiply(const std::vector<real>& vector, std::vector<real>& result) const;
+
+	public:
+		ParticleSpringNetwork(ParticleStore* store, unsigned maxIterations = 50, real tolerance = ((real)1e-4));
+
+		// Link two particles of the store, return the index of the link
+		unsigned addLink(Particle* first, Particle* second, real springConstant, real restLength);
+
+		// Remove a link in constant time, the last link takes its index
+		void removeLink(unsigned index);
+
+		// Remove all the links of a particle
+		void removeAllFor(Particle* particle);
+
+		void clear();
+
+		// Number of links
+		unsigned size() const { return (unsigned)links.size(); }
+
+		// Conjugate gradient iterations, and residual at which the solve stops, relative to the right hand side
+		void setIterations(unsigned maxIterations) { ParticleSpringNetwork::maxIterations = maxIterations; }
+		void setTolerance(real tolerance) { ParticleSpringNetwork::tolerance = tolerance; }
+
+		// Iterations taken by the last update
+		unsigned getIterationsUsed() const { return iterationsUsed; }
+
+		// Solve the implicit step of the given duration and add the resulting forces to the particles
+		void updateForces(real duration);
+	};
+}
+
+#endif// CYCLONE_PNETWORK_H
\ No newline at end of file
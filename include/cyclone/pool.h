@@ -0,0 +1,180 @@
+#ifndef CYCLONE_POOL_H
+#define CYCLONE_POOL_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cyclone {
+
+	// Fixed size object allocator. Objects are carved out of chunks of ChunkSize slots, and freed slots
+	// are chained in a free list, so create and destroy are O(1) and never touch the heap once the pool
+	// has grown to its working size. Objects created one after the other are contiguous in memory.
+	// Objects still alive when the pool is destroyed are released without calling their destructor,
+	// hence the restriction to trivially destructible types (all the particles and built-in generators)
+	template<class T, unsigned ChunkSize = 256>
+	class ObjectPool {
+		static_assert(std::is_trivially_destructible<T>::value, "Pooled types must be trivially destructible");
+
+	protected:
+		union Slot {
+			Slot* next;
+			alignas(T) unsigned char storage[sizeof(T)];
+		};
+
+		std::vector<Slot*> chunks;
+		Slot* freeList;
+		unsigned count;
+
+		// Add a chunk of free slots, linked in address order
+		void grow() {
+			Slot* chunk = new Slot[ChunkSize];
+			chunks.push_back(chunk);
+			for (unsigned i = ChunkSize; i > 0; --i) {
+				chunk[i - 1].next = freeList;
+				freeList = &chunk[i - 1];
+			}
+		}
+
+	public:
+		ObjectPool() : freeList(0), count(0) {}
+
+		~ObjectPool() {
+			for (unsigned i = 0; i < chunks.size(); ++i) {
+				delete[] chunks[i];
+			}
+		}
+
+		ObjectPool(const ObjectPool&) = delete;
+		ObjectPool& operator=(const ObjectPool&) = delete;
+
+		// Construct an object in a free slot
+		template<class... Args>
+		T* create(Args&&... args) {
+			if (!freeList) {
+				grow();
+			}
+			Slot* slot = freeList;
+			freeList = slot->next;
+			++count;
+			return new (slot->storage) T(std::forward<Args>(args)...);
+		}
+
+		// Destroy an object created by this pool
+		void destroy(T* object) {
+			object->~T();
+			Slot* slot = reinterpret_cast<Slot*>(object);
+			slot->next = freeList;
+			freeList = slot;
+			--count;
+		}
+
+		// Grow the pool so it can hold capacity objects without allocating
+		void reserve(unsigned capacity) {
+			while (getCapacity() < capacity) {
+				grow();
+			}
+		}
+
+		// Number of live objects
+		unsigned size() const { return count; }
+
+		unsigned getCapacity() const { return (unsigned)chunks.size() * ChunkSize; }
+	};
+
+	// Free list of fixed size blocks behind the node based containers of the engine. The block size is
+	// set by the first single object allocation, allocations of any other size go to the heap
+	class NodePool {
+	protected:
+		std::vector<void*> chunks;
+		void* freeList;
+		size_t nodeSize;
+		unsigned nodesPerChunk;
+
+	public:
+		NodePool(unsigned nodesPerChunk = 256);
+		~NodePool();
+
+		NodePool(const NodePool&) = delete;
+		NodePool& operator=(const NodePool&) = delete;
+
+		// True if single objects of the given size come from the pool
+		bool accepts(size_t size) {
+			// Free nodes hold the link of the free list
+			if (size < sizeof(void*)) {
+				size = sizeof(void*);
+			}
+			if (nodeSize == 0) {
+				nodeSize = size;
+			}
+			return size == nodeSize;
+		}
+
+		void* allocate(size_t size, size_t count);
+		void deallocate(void* pointer, size_t size, size_t count);
+	};
+
+	// Standard allocator drawing the nodes of a container from a NodePool shared by its copies
+	template<class T>
+	class PoolAllocator {
+	public:
+		typedef T value_type;
+
+		NodePool* pool;
+
+		PoolAllocator(NodePool* pool) : pool(pool) {}
+
+		template<class U>
+		PoolAllocator(const PoolAllocator<U>& other) : pool(other.pool) {}
+
+		T* allocate(size_t count) { return (T*)pool->allocate(sizeof(T), count); }
+		void deallocate(T* pointer, size_t count) { pool->deallocate(pointer, sizeof(T), count); }
+
+		template<class U>
+		bool operator==(const PoolAllocator<U>& other) const { return pool == other.pool; }
+		template<class U>
+		bool operator!=(const PoolAllocator<U>& other) const { return pool != other.pool; }
+	};
+
+	// Bump allocator for objects living a single frame. Allocation moves a cursor through a list of
+	// blocks and reset releases everything at once, keeping the blocks for the next frame
+	class FrameArena {
+	protected:
+		struct Block {
+			unsigned char* data;
+			size_t size;
+		};
+		std::vector<Block> blocks;
+		size_t blockSize;
+		unsigned currentBlock;
+		size_t offset; // Used bytes of the current block
+		size_t used; // Allocated bytes since the last reset
+
+	public:
+		FrameArena(size_t blockSize = 64 * 1024);
+		~FrameArena();
+
+		FrameArena(const FrameArena&) = delete;
+		FrameArena& operator=(const FrameArena&) = delete;
+
+		// Allocate size bytes with the given alignment (a power of two)
+		void* allocate(size_t size, size_t alignment);
+
+		// Construct an object in the arena, released by the next reset without calling its destructor
+		template<class T, class... Args>
+		T* create(Args&&... args) {
+			static_assert(std::is_trivially_destructible<T>::value, "Arena types must be trivially destructible");
+			return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		}
+
+		// Release all the allocations
+		void reset();
+
+		// Bytes allocated since the last reset
+		size_t getUsed() const { return used; }
+	};
+}
+
+#endif// CYCLONE_POOL_H
\ No newline at end of file
@@ -0,0 +1,80 @@
+#ifndef CYCLONE_PQUERY_H
+#define CYCLONE_PQUERY_H
+
+#include "precision.h"
+#include "core.h"
+#include "jobs.h"
+#include "pgrid.h"
+#include "pstore.h"
+
+namespace cyclone {
+
+	// Ray against the particles. The direction must be of unit length and maxDistance finite, it bounds
+	// the walk through the grid
+	struct ParticleRay {
+		Vector3 origin;
+		Vector3 direction;
+		real maxDistance;
+	};
+
+	// Closest particle hit by a ray, particle is ParticleQuery::NO_PARTICLE if the ray hit nothing
+	struct ParticleRayHit {
+		unsigned particle;
+		real distance;
+	};
+
+	// Sphere overlapping the particles, e.g. the blast of an explosion
+	struct ParticleSphere {
+		Vector3 centre;
+		real radius;
+	};
+
+	// Ray casts and sphere queries against the particles of a store, seen as spheres of the same radius.
+	// The queries go through a ParticleGrid of the positions, rebuilt by update. Results are particle
+	// indices in the store (see ParticleStore::getParticle), valid until particles are created or
+	// destroyed.
+	//
+	// The queries are const and keep no scratch state: any number of threads may run them at the same
+	// time, and while other threads read the world, but not while the world steps or update runs
+	class ParticleQuery {
+	public:
+		enum { NO_PARTICLE = 0xffffffff };
+
+	protected:
+		const ParticleStore* store;
+		real radius;
+		ParticleGrid grid;
+
+	public:
+		// The cell size is at least the particle radius, the default is the particle diameter. Larger
+		// cells suit sparse worlds and large query spheres
+		ParticleQuery(const ParticleStore* store, real particleRadius, real cellSize = 0);
+
+		// Rebuild the grid from the current positions, after each step and before the queries
+		void update();
+
+		const ParticleStore* getStore() const { return store; }
+
+		// Number of particles in the grid at the last update
+		unsigned size() const { return grid.size(); }
+
+		// Find the closest particle hit by the ray, return false if there is none
+		bool raycast(const ParticleRay& ray, ParticleRayHit& hit) const;
+
+		// Cast count rays, writing the hit of ray i in hits[i]
+		void raycast(const ParticleRay* rays, unsigned count, ParticleRayHit* hits) const;
+		void raycast(const ParticleRay* rays, unsigned count, ParticleRayHit* hits, JobSystem& jobs) const;
+
+		// Write the particles touching the sphere in results, at most maxResults of them in no particular
+		// order. Return the number of particles touching it, which may be more than maxResults. The cost
+		// follows the cells of the sphere, up to one pass over the particles for very large spheres
+		unsigned querySphere(const ParticleSphere& sphere, unsigned* results, unsigned maxResults) const;
+
+		// Run count sphere queries. Query i writes its particles in results[i * maxResults ...] and
+		// its count, which may be more than maxResults, in resultCounts[i]
+		void querySphere(const ParticleSphere* spheres, unsigned count, unsigned* results, unsigned maxResults, unsigned* resultCounts) const;
+		void querySphere(const ParticleSphere* spheres, unsigned count, unsigned* results, unsigned maxResults, unsigned* resultCounts, JobSystem& jobs) const;
+	};
+}
+
+#endif// CYCLONE_PQUERY_H
\ No newline at end of file
@@ -1,10 +1,30 @@
 #ifndef CYCLONE_PRECISION_H
 #define CYCLONE_PRECISION_H
 
+#include <cfloat>
 #include <cmath>
 #include <limits>
 
+// Reals are single precision unless CYCLONE_DOUBLE_PRECISION is defined (CMake option CYCLONE_PRECISION).
+// The SIMD backends only exist for single precision, double builds always use the scalar code.
+
 namespace cyclone {
+#if defined(CYCLONE_DOUBLE_PRECISION)
+	// Define the precision of the floating point numbers
+	typedef double real;
+
+	// Define the precision of the square root operator
+	#define real_sqrt sqrt
+
+	// Define the precision of the power operator
+	#define real_pow pow
+
+	// Define max for reals
+	#define REAL_MAX DBL_MAX
+
+	// Define the precision of the absolute magnitude operator
+	#define real_abs fabs
+#else
 	// Define the precision of the floating point numbers
 	typedef float real;
 
@@ -15,10 +35,29 @@ namespace cyclone {
 	#define real_pow powf
 	
 	// Define max for reals
-	#define REAL_MAX DBL_MAX
+	#define REAL_MAX FLT_MAX
 	
 	// Define the precision of the absolute magnitude operator
 	#define real_abs fabsf
+#endif
+
+	// Deterministic builds (CMake option CYCLONE_DETERMINISTIC) avoid the libm power function, whose
+	// results may differ between machines running the same binary, see determinism.h
+#if defined(CYCLONE_DETERMINISTIC)
+	double deterministicPow(double base, double exponent);
+
+	#undef real_pow
+	#define real_pow(base, exponent) ((real)cyclone::deterministicPow(base, exponent))
+#endif
+
+	// Define the precision of the particle positions held by a ParticleStore. With CYCLONE_MIXED_PRECISION
+	// a single precision build keeps them in double, so particles far from the origin do not lose
+	// precision, while velocities, forces and the rest of the step math stay in float
+#if defined(CYCLONE_MIXED_PRECISION) && !defined(CYCLONE_DOUBLE_PRECISION)
+	typedef double position_real;
+#else
+	typedef real position_real;
+#endif
 }
 
 #endif// CYCLONE_PRECISION_H
\ No newline at end of file
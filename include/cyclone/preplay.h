@@ -0,0 +1,165 @@
+#ifndef CYCLONE_PREPLAY_H
+#define CYCLONE_PREPLAY_H
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "precision.h"
+#include "pstore.h"
+
+namespace cyclone {
+
+	// Recording of particle trajectories for offline analysis. Each frame holds the positions, and
+	// optionally the velocities, of all the particles. The values are quantized to a fixed precision
+	// and each frame is encoded as the difference with the linear prediction from the two frames
+	// before it, in variable length integers. A keyframe, encoded on its own, starts every
+	// keyframeInterval frames and whenever the particle count changes, so a reader can seek to any
+	// frame by decoding from the keyframe before it.
+	//
+	// Not a portable format: it uses the byte order of the machine. Values that are not finite are
+	// kept as NaN, so a blown up particle shows in the replay.
+
+	struct ParticleReplayHeader {
+		char magic[4]; // "CYRP"
+		unsigned version;
+		unsigned channelCount; // 3 with positions only, 6 with velocities
+		unsigned keyframeInterval;
+		double positionPrecision; // Quantization step of the positions
+		double velocityPrecision; // and of the velocities
+	};
+
+	struct ParticleReplayFrameHeader {
+		unsigned flags; // REPLAY_KEYFRAME
+		unsigned particleCount;
+		double time; // Simulated time at the end of the frame
+		unsigned long long payloadSize; // Bytes of encoded values following the header
+	};
+
+	enum {
+		REPLAY_VERSION = 1,
+		REPLAY_KEYFRAME = 1
+	};
+
+	// Values of a frame, as read back from a recording
+	struct ParticleReplayFrame {
+		double time;
+		unsigned particleCount;
+		std::vector<position_real> positionX, positionY, positionZ;
+		std::vector<real> velocityX, velocityY, velocityZ; // Empty if the velocities were not recorded
+	};
+
+	// Records the particles of a world from the simulation thread. record only copies the arrays into a
+	// ring of frame buffers, a background thread encodes the frames and writes them to the file. When
+	// the ring is full record waits for the writer, no frame is ever dropped
+	class ParticleReplayRecorder {
+	protected:
+		// Raw copy of a frame, waiting in the ring
+		struct Frame {
+			double time;
+			std::vector<position_real> positionX, positionY, positionZ;
+			std::vector<real> velocityX, velocityY, velocityZ;
+		};
+
+		std::vector<Frame> ring;
+		unsigned readIndex; // Next frame for the writer
+		unsigned queued; // Frames in the ring, from readIndex on
+
+		std::mutex mutex;
+		std::condition_variable frameQueued;
+		std::condition_variable frameWritten;
+		std::thread writer;
+		bool stopping;
+
+		FILE* file;
+		ParticleReplayHeader header;
+		double time;
+		unsigned long long frameCount;
+		bool failed; // A write failed, set by the writer thread
+
+		// Writer thread state: quantized values of the last two frames, per channel and particle
+		std::vector<long long> previous[6];
+		std::vector<long long> beforePrevious[6];
+		unsigned history; // Frames encoded since the last keyframe, included
+		unsigned lastCount;
+		std::vector<unsigned char> payload;
+
+		// Writer thread main loop
+		void writerLoop();
+
+		// Encode a frame and write it to the file, return false on a write error
+		bool writeFrame(const Frame& frame);
+
+	public:
+		// Create a recorder buffering at most bufferFrames frames ahead of the writer thread
+		ParticleReplayRecorder(unsigned bufferFrames = 8);
+		~ParticleReplayRecorder();
+
+		ParticleReplayRecorder(const ParticleReplayRecorder&) = delete;
+		ParticleReplayRecorder& operator=(const ParticleReplayRecorder&) = delete;
+
+		// Start recording to a new file. Positions are kept within positionPrecision / 2, velocities
+		// within velocityPrecision / 2. Return false if the file cannot be created
+		bool open(const char* filename, double positionPrecision = 1e-4, double velocityPrecision = 1e-3,
+			unsigned keyframeInterval = 60, bool recordVelocities = true);
+
+		// Write the frames still in the ring and close the file. Return false if a write failed
+		bool close();
+
+		bool isOpen() const { return file != 0; }
+
+		// Add a frame with the current state of the particles, duration being the time simulated since
+		// the last frame. ParticleWorld calls it after each step once set as the recorder of the world
+		void record(const ParticleStore& particles, real duration);
+
+		// Number of frames recorded since open
+		unsigned long long getFrameCount() const { return frameCount; }
+	};
+
+	// Reads a recording back, in any order
+	class ParticleReplayReader {
+	protected:
+		// Position of a frame in the file
+		struct FrameEntry {
+			long long offset; // Of the payload
+			ParticleReplayFrameHeader header;
+			unsigned keyframe; // Index of the keyframe the frame is decoded from
+		};
+
+		FILE* file;
+		ParticleReplayHeader header;
+		std::vector<FrameEntry> frames;
+
+		// Quantized values of the last decoded frame and of the one before it
+		std::vector<long long> previous[6];
+		std::vector<long long> beforePrevious[6];
+		unsigned current; // Index of the last decoded frame, or the frame count if none
+		std::vector<unsigned char> payload;
+
+		// Decode the frame following the current one, or the keyframe given
+		bool decodeFrame(unsigned index);
+
+	public:
+		ParticleReplayReader();
+		~ParticleReplayReader();
+
+		ParticleReplayReader(const ParticleReplayReader&) = delete;
+		ParticleReplayReader& operator=(const ParticleReplayReader&) = delete;
+
+		// Open a recording and index its frames. A recording cut short, by a crash for instance, is read
+		// up to its last complete frame. Return false if the file is not a recording
+		bool open(const char* filename);
+		void close();
+
+		unsigned getFrameCount() const { return (unsigned)frames.size(); }
+		bool hasVelocities() const { return header.channelCount == 6; }
+
+		// Read a frame. Reading the frames in order decodes each of them once, seeking decodes from the
+		// keyframe before the frame. Return false if the frame does not exist or cannot be read
+		bool readFrame(unsigned index, ParticleReplayFrame& frame);
+	};
+}
+
+#endif// CYCLONE_PREPLAY_H
\ No newline at end of file
@@ -0,0 +1,173 @@
+#ifndef CYCLONE_PROFILE_H
+#define CYCLONE_PROFILE_H
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+// Instrumentation of the simulation step. The CYCLONE_PROFILE_* macros compile to nothing unless
+// CYCLONE_PROFILING is defined (CMake option CYCLONE_ENABLE_PROFILING), the Profiler itself is always
+// available so code querying the stats builds in both configurations.
+
+namespace cyclone {
+
+	// Phases of the simulation timed by the profiler
+	enum ProfilePhase {
+		PROFILE_FRAME,              // ParticleWorld::runPhysics
+		PROFILE_STEP,               // One fixed step
+		PROFILE_FORCES,             // ParticleForceRegistry::updateForces
+		PROFILE_INTEGRATION,        // Particle integration
+		PROFILE_CONTACT_GENERATION, // Contact generators
+		PROFILE_CONTACT_RESOLUTION, // Contact resolver
+		PROFILE_QUERY,              // Rebuild of the spatial query of the world
+		PROFILE_PHASE_COUNT
+	};
+
+	// Force generator types, in the same order as the buckets of the force registry
+	enum ProfileGenerator {
+		PROFILE_GENERATOR_GRAVITY,
+		PROFILE_GENERATOR_DRAG,
+		PROFILE_GENERATOR_SPRING,
+		PROFILE_GENERATOR_ANCHORED_SPRING,
+		PROFILE_GENERATOR_BUNGEE,
+		PROFILE_GENERATOR_BUOYANCY,
+		PROFILE_GENERATOR_GENERIC, // Any other generator, and every generator when the registry is not bucketed
+		PROFILE_GENERATOR_COUNT
+	};
+
+	// Statistics accumulated since the last Profiler::reset. Times are in seconds
+	struct ProfileStats {
+		double phaseTime[PROFILE_PHASE_COUNT];
+		unsigned phaseCalls[PROFILE_PHASE_COUNT];
+
+		// Registrations processed per generator type (sleeping particles included) and the time spent
+		// on them. The parallel update only reports the counts, its time goes to PROFILE_FORCES
+		unsigned long long generatorCalls[PROFILE_GENERATOR_COUNT];
+		double generatorTime[PROFILE_GENERATOR_COUNT];
+
+		// Counters sampled at the end of the last step
+		unsigned particles;
+		unsigned awakeParticles;
+		unsigned registrations;
+		unsigned contacts;
+
+		ProfileStats() { clear(); }
+
+		void clear();
+	};
+
+	// Collects the stats of all the worlds and registries of the process, and optionally a trace
+	// of the timed scopes in the Chrome trace event format (chrome://tracing, Perfetto)
+	class Profiler {
+	protected:
+		// A completed scope of the trace
+		struct TraceEvent {
+			unsigned phase;
+			unsigned thread;
+			double start;
+			double duration;
+		};
+
+		// Counters sample of the trace
+		struct TraceCounters {
+			double time;
+			unsigned particles;
+			unsigned awakeParticles;
+			unsigned contacts;
+		};
+
+		mutable std::mutex mutex;
+		ProfileStats stats;
+
+		std::chrono::steady_clock::time_point epoch;
+
+		bool tracing;
+		unsigned maxTraceEvents;
+		std::vector<TraceEvent> traceEvents;
+		std::vector<TraceCounters> traceCounters;
+
+		Profiler();
+
+	public:
+		Profiler(const Profiler&) = delete;
+		Profiler& operator=(const Profiler&) = delete;
+
+		// The process wide profiler
+		static Profiler& get();
+
+		// Seconds elapsed since the profiler was created
+		double now() const {
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - epoch).count();
+		}
+
+		// Copy of the stats accumulated so far
+		ProfileStats getStats() const;
+
+		// Clear the stats, e.g. at the beginning of each frame to get per frame numbers
+		void reset();
+
+		// Record a timed scope, started at the given time (see now())
+		void addPhase(ProfilePhase phase, double start, double duration);
+
+		// Record the registrations processed for a generator type
+		void addGenerator(ProfileGenerator generator, unsigned calls, double duration);
+
+		// Sample the counters
+		void setCounters(unsigned particles, unsigned awakeParticles, unsigned registrations, unsigned contacts);
+
+		// Start recording the trace, discarding the previous one. Recording stops when the buffer
+		// reaches maxEvents, so a trace left running on a live server does not grow without bounds
+		void startTrace(unsigned maxEvents = 1 << 20);
+		void stopTrace();
+		bool isTracing() const;
+
+		// Write the recorded trace as Chrome trace event JSON, return false if the file cannot be written
+		bool writeTrace(const char* filename) const;
+
+		static const char* getPhaseName(ProfilePhase phase);
+		static const char* getGeneratorName(ProfileGenerator generator);
+	};
+
+	// Times the enclosing scope
+	class ProfileScope {
+		ProfilePhase phase;
+		double start;
+	public:
+		ProfileScope(ProfilePhase phase) : phase(phase), start(Profiler::get().now()) {}
+		~ProfileScope() {
+			Profiler& profiler = Profiler::get();
+			profiler.addPhase(phase, start, profiler.now() - start);
+		}
+	};
+
+	// Times the enclosing scope and charges it to a generator type
+	class ProfileGeneratorScope {
+		ProfileGenerator generator;
+		unsigned calls;
+		double start;
+	public:
+		ProfileGeneratorScope(ProfileGenerator generator, unsigned calls) :
+			generator(generator), calls(calls), start(Profiler::get().now()) {}
+		~ProfileGeneratorScope() {
+			Profiler& profiler = Profiler::get();
+			profiler.addGenerator(generator, calls, profiler.now() - start);
+		}
+	};
+}
+
+#if defined(CYCLONE_PROFILING)
+	#define CYCLONE_PROFILE_SCOPE(phase) cyclone::ProfileScope cycloneProfileScope(phase)
+	#define CYCLONE_PROFILE_GENERATOR_SCOPE(generator, calls) \
+		cyclone::ProfileGeneratorScope cycloneProfileGeneratorScope((cyclone::ProfileGenerator)(generator), (unsigned)(calls))
+	#define CYCLONE_PROFILE_GENERATOR_CALLS(generator, calls) \
+		cyclone::Profiler::get().addGenerator((cyclone::ProfileGenerator)(generator), (unsigned)(calls), 0)
+	#define CYCLONE_PROFILE_COUNTERS(particles, awakeParticles, registrations, contacts) \
+		cyclone::Profiler::get().setCounters(particles, awakeParticles, registrations, contacts)
+#else
+	#define CYCLONE_PROFILE_SCOPE(phase)
+	#define CYCLONE_PROFILE_GENERATOR_SCOPE(generator, calls)
+	#define CYCLONE_PROFILE_GENERATOR_CALLS(generator, calls)
+	#define CYCLONE_PROFILE_COUNTERS(particles, awakeParticles, registrations, contacts)
+#endif
+
+#endif// CYCLONE_PROFILE_H
\ No newline at end of file
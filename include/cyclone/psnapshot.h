@@ -0,0 +1,172 @@
+#ifndef CYCLONE_PSNAPSHOT_H
+#define CYCLONE_PSNAPSHOT_H
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+#include "precision.h"
+#include "pfgen.h"
+
+namespace cyclone {
+	class ParticleWorld;
+
+	// Binary snapshots of the particles of a world and their force registrations, for checkpoints and
+	// rollback. A snapshot is a header followed by one array per particle field, laid out exactly as in
+	// ParticleStore, so restoring copies whole arrays out of the memory mapped file without parsing.
+	// Registrations are saved as pairs of particle index and index in a generator table given by the
+	// caller, since generators are user objects. The contact generators, force fields and spring
+	// networks of the world are configuration and are not saved.
+	//
+	// The format uses the byte order of the machine and the reals of the build, a snapshot is only
+	// read back by a build of the same precision.
+
+	// Generators referred to by the registrations of a snapshot, by position in the table. It must hold
+	// every generator registered in the world, transient ones included
+	typedef std::vector<ParticleForceGenerator*> GeneratorTable;
+
+	// Arrays of a snapshot. Each section holds one value per record, except the registrations
+	enum ParticleSnapshotSection {
+		SNAPSHOT_INDEX,          // Delta only: index of each record in the world, increasing
+		SNAPSHOT_POSITION_X, SNAPSHOT_POSITION_Y, SNAPSHOT_POSITION_Z,
+		SNAPSHOT_VELOCITY_X, SNAPSHOT_VELOCITY_Y, SNAPSHOT_VELOCITY_Z,
+		SNAPSHOT_ACCELERATION_X, SNAPSHOT_ACCELERATION_Y, SNAPSHOT_ACCELERATION_Z,
+		SNAPSHOT_FORCE_X, SNAPSHOT_FORCE_Y, SNAPSHOT_FORCE_Z,
+		SNAPSHOT_INVERSE_MASS,
+		SNAPSHOT_MASS,
+		SNAPSHOT_DAMPING,
+		SNAPSHOT_MOTION,
+		SNAPSHOT_AWAKE,
+		SNAPSHOT_CAN_SLEEP,
+		SNAPSHOT_REGISTRATIONS,  // Particle index and generator index of each registration
+		SNAPSHOT_SECTION_COUNT
+	};
+
+	enum {
+		SNAPSHOT_VERSION = 2,
+
+		// Header flags
+		SNAPSHOT_DELTA = 1,                // Only the records of the particles changed since the base
+		SNAPSHOT_SAME_REGISTRATIONS = 2    // Delta whose registrations are the ones of the base
+	};
+
+	struct ParticleSnapshotHeader {
+		char magic[4]; // "CYPS"
+		unsigned version;
+		unsigned flags;
+		unsigned realSize; // sizeof(real) and sizeof(position_real) of the build that wrote it
+		unsigned positionSize;
+		unsigned particleCount; // Particles in the world
+		unsigned recordCount; // Particles saved, all of them unless SNAPSHOT_DELTA
+		unsigned registrationCount;
+		unsigned long long stateHash; // ParticleWorld::getStateHash of the saved state
+		unsigned long long contentHash; // Hash of everything saved: all the arrays, the registrations and the accumulator
+		unsigned long long baseContentHash; // Delta: content hash of the world the delta applies to
+		double accumulator;
+		unsigned long long sections[SNAPSHOT_SECTION_COUNT]; // Offset of each array from the start, 64 byte aligned
+	};
+
+	// Read only view of a snapshot held in memory. The arrays are read in place
+	class ParticleSnapshotView {
+	protected:
+		const unsigned char* data;
+		size_t size;
+
+	public:
+		ParticleSnapshotView(const void* data = 0, size_t size = 0);
+
+		// True if the data holds a snapshot of this version and precision, with all its sections inside
+		bool isValid() const;
+
+		bool isDelta() const { return (getHeader().flags & SNAPSHOT_DELTA) != 0; }
+
+		const ParticleSnapshotHeader& getHeader() const { return *(const ParticleSnapshotHeader*)data; }
+
+		// Start of the array of a section
+		const void* getSection(unsigned section) const { return data + getHeader().sections[section]; }
+
+		// Set the world to the state saved in the snapshot. A delta only applies to the state it was taken
+		// against: the content hash of the world, every field and the registrations, must be its base
+		// one. Particle i of the snapshot takes the handle at index i in the world, particles are created
+		// or destroyed at the end to match the count, and the registrations are replaced (their handles
+		// become invalid). Returns false, leaving the world untouched, when the snapshot is invalid or
+		// does not apply
+		bool restore(ParticleWorld& world, const GeneratorTable& generators) const;
+	};
+
+	// Snapshot file mapped in memory (read into memory where mmap is not available)
+	class ParticleSnapshotFile : public ParticleSnapshotView {
+	protected:
+		void* mapping;
+		size_t mappingSize;
+		std::vector<unsigned char> buffer; // Contents of the file without mmap
+
+	public:
+		ParticleSnapshotFile();
+		~ParticleSnapshotFile();
+
+		ParticleSnapshotFile(const ParticleSnapshotFile&) = delete;
+		ParticleSnapshotFile& operator=(const ParticleSnapshotFile&) = delete;
+
+		// Map a snapshot file, return false if it cannot be read or is not a valid snapshot
+		bool open(const char* filename);
+		void close();
+	};
+
+	// Writes the snapshots of a world. The writer keeps a copy of the last snapshot written, the base of
+	// the next delta
+	class ParticleSnapshotWriter {
+	protected:
+		// State of the last snapshot, the bytes of each array of the store
+		std::vector<unsigned char> base[SNAPSHOT_SECTION_COUNT];
+		unsigned baseCount;
+		std::vector<unsigned> registrations;
+		unsigned long long baseContentHash;
+		bool hasBase;
+
+		// Index of each generator of the last table
+		typedef std::unordered_map<ParticleForceGenerator*, unsigned> GeneratorIndex;
+		GeneratorTable indexedTable;
+		GeneratorIndex generatorIndex;
+
+		// Registrations of the world being written
+		std::vector<Particle*> registeredParticles;
+		std::vector<ParticleForceGenerator*> registeredGenerators;
+		std::vector<unsigned> currentRegistrations;
+
+		// Records of the delta being written
+		std::vector<unsigned char> dirty;
+		std::vector<unsigned> changed;
+		std::vector<unsigned char> scratch;
+
+		unsigned lastRecordCount;
+
+		// Translate the registrations of the world into indices, false if a generator is not in the table
+		bool buildRegistrations(const ParticleWorld& world, const GeneratorTable& generators);
+
+		bool write(const char* filename, const ParticleWorld& world, bool delta);
+
+		// Copy the state of the world as the base of the next delta. After a delta only the particles
+		// added since the previous base are left to copy
+		void setBase(const ParticleWorld& world, unsigned long long contentHash, bool compared);
+
+	public:
+		ParticleSnapshotWriter();
+
+		// Write a snapshot of all the particles. Return false if the file cannot be written or a
+		// registered generator is not in the table
+		bool writeFull(const char* filename, const ParticleWorld& world, const GeneratorTable& generators);
+
+		// Write only the particles changed since the last snapshot (compared bit for bit). Without a
+		// previous snapshot this writes a full one
+		bool writeDelta(const char* filename, const ParticleWorld& world, const GeneratorTable& generators);
+
+		// Forget the base, the next delta is written in full
+		void reset() { hasBase = false; }
+
+		// Number of particles saved by the last snapshot
+		unsigned getLastRecordCount() const { return lastRecordCount; }
+	};
+}
+
+#endif// CYCLONE_PSNAPSHOT_H
\ No newline at end of file
@@ -0,0 +1,233 @@
+#ifndef CYCLONE_PSTORE_H
+#define CYCLONE_PSTORE_H
+
+#include <atomic>
+#include <deque>
+#include <vector>
+
+#include "precision.h"
+#include "determinism.h"
+#include "particle.h"
+
+namespace cyclone {
+
+	// Holds the data of many particles in contiguous per-component arrays (structure of arrays).
+	// Particles created by the store are lightweight handles indexing into the arrays, so they can
+	// be used everywhere a Particle* is expected (force generators, registries...).
+	class ParticleStore {
+	public:
+		// Per-component arrays, one entry per particle. Positions may be more precise than the rest, see position_real
+		std::vector<position_real> positionX, positionY, positionZ;
+		std::vector<real> velocityX, velocityY, velocityZ;
+		std::vector<real> accelerationX, accelerationY, accelerationZ;
+		std::vector<real> forceX, forceY, forceZ;
+		std::vector<real> inverseMass;
+		std::vector<real> mass; // 1 / inverseMass, zero for infinite masses. Kept by setInverseMass for the division free generators
+		std::vector<real> damping;
+
+		// Sleep data, see Particle::setAwake
+		std::vector<real> motion;
+		std::vector<unsigned char> awake;
+		std::vector<unsigned char> canSleep;
+
+	protected:
+		// Handle owning each index
+		std::vector<Particle*> handles;
+
+		// Handles storage, a deque keeps their address stable while the store grows
+		std::deque<Particle> handlePool;
+
+		// Handles released by destroyParticle, ready to be reused
+		std::vector<Particle*> freeHandles;
+
+		// Hash contribution of each particle and their sum, kept while stateHashing is set, see setStateHashing.
+		// The integration ranges add their change of the sum once each, which the order independent sum
+		// allows from any thread
+		bool stateHashing;
+		std::vector<unsigned long long> stateHashes;
+		std::atomic<unsigned long long> stateHash;
+
+		// Integrate the particles in the range with explicit or symplectic Euler. bias is the weight of the
+		// previous motion in the sleep average, drag.getFactor(damping) gives real_pow(damping, duration)
+		template<bool Symplectic, class Drag>
+		void integrateExplicit(unsigned begin, unsigned end, real duration, real bias, Drag& drag);
+
+		// Update the motion average of an awake particle that can sleep, putting it to sleep if at rest
+		void updateSleep(unsigned index, real bias);
+
+		// Number of particles the integration moves before hashing them, small enough to stay in the cache
+		enum { HASH_BLOCK = 512 };
+
+		// Recompute the hash contributions of the particles in the range [begin, end), return the change
+		// of their sum
+		unsigned long long rehashRange(unsigned begin, unsigned end);
+
+		// Recompute the hash contribution of a particle and update the sum
+		void updateParticleHash(unsigned index);
+
+	public:
+		ParticleStore();
+
+		ParticleStore(const ParticleStore&) = delete;
+		ParticleStore& operator=(const ParticleStore&) = delete;
+
+		// Reserve memory for the given number of particles
+		void reserve(unsigned capacity);
+
+		// Add a particle to the store and return its handle
+		Particle* createParticle();
+
+		// Remove a particle from the store. The last particle is moved into its slot, so indices
+		// are not stable across removals, handles are
+		void destroyParticle(Particle* particle);
+
+		// Remove all the particles
+		void clear();
+
+		// Number of particles in the store
+		unsigned size() const { return (unsigned)handles.size(); }
+
+		// Number of particles awake
+		unsigned getAwakeCount() const;
+
+		// Handle of the particle at the given index
+		Particle* getParticle(unsigned index) const { return handles[index]; }
+
+		// Integrate a single particle forward in time
+		void integrate(unsigned index, real duration);
+
+		// Same, with the factors depending on the duration computed by the caller: dampingFactor is
+		// real_pow(damping, duration) for the damping of the particle and sleepBias real_pow(0.5, duration).
+		// Particle::integrate passes the ones cached by the handle, saving the two powers
+		void integrate(unsigned index, real duration, real dampingFactor, real sleepBias);
+
+		// Integrate all the particles forward in time, same update as Particle::integrate.
+		// Sleeping particles are skipped
+		void integrateAll(real duration);
+
+		// Integrate the particles in the range [begin, end)
+		void integrateRange(unsigned begin, unsigned end, real duration);
+
+		// Integrate the particles in the range [begin, end) with symplectic (semi-implicit) Euler: the
+		// velocity is updated first and the particle moves with the new one. Much more stable on springs
+		void integrateSymplecticRange(unsigned begin, unsigned end, real duration);
+
+		// Apply the damping, clear the forces and update the sleep state of the particles in the range with
+		// a nonzero stepped entry, the common end of the integrators that update the positions and velocities
+		// themselves. stepped flags the particles the integrator moved, the others are left untouched
+		void completeStepRange(unsigned begin, unsigned end, real duration, const unsigned char* stepped);
+
+		// Clear the force accumulators of all the particles
+		void clearAccumulators();
+
+		// Hash of the positions, velocities and sleep states (awake flag and motion average) of the particles,
+		// the sum of a hash of each particle, so it does not depend on their order. Constant time while the
+		// store keeps the hash, see setStateHashing, a pass over all the particles otherwise
+		unsigned long long getStateHash() const;
+
+		// Keep the hash of each particle and their sum up to date: the integration hashes the particles it
+		// moves, in blocks still in the cache, and the accessors below the particles they write. Lockstep
+		// games checking the hash every frame turn it on, it costs about a third of the time of the explicit
+		// integration. Code writing the arrays directly must call rehashParticle or rehashState afterwards
+		void setStateHashing(bool stateHashing);
+		bool getStateHashing() const { return stateHashing; }
+
+		// Recompute the hash of a particle after its arrays were written directly, when keeping the hash
+		void rehashParticle(unsigned index) {
+			if (stateHashing) {
+				updateParticleHash(index);
+			}
+		}
+
+		// Recompute the hashes of all the particles, when keeping the hash
+		void rehashState();
+
+		// Per particle accessors used by the handles
+		Vector3 getPosition(unsigned index) const {
+			return Vector3((real)positionX[index], (real)positionY[index], (real)positionZ[index]);
+		}
+
+		void setPosition(unsigned index, const Vector3& position) {
+			positionX[index] = position.x;
+			positionY[index] = position.y;
+			positionZ[index] = position.z;
+			rehashParticle(index);
+		}
+
+		// Move a particle, in the precision of the positions
+		void translate(unsigned index, const Vector3& offset) {
+			positionX[index] += offset.x;
+			positionY[index] += offset.y;
+			positionZ[index] += offset.z;
+			rehashParticle(index);
+		}
+
+		// Position of a particle relative to another, the difference is taken in the precision of the positions
+		Vector3 getSeparation(unsigned index, unsigned other) const {
+			return Vector3(
+				(real)(positionX[index] - positionX[other]),
+				(real)(positionY[index] - positionY[other]),
+				(real)(positionZ[index] - positionZ[other]));
+		}
+
+		Vector3 getVelocity(unsigned index) const {
+			return Vector3(velocityX[index], velocityY[index], velocityZ[index]);
+		}
+
+		void setVelocity(unsigned index, const Vector3& velocity) {
+			velocityX[index] = velocity.x;
+			velocityY[index] = velocity.y;
+			velocityZ[index] = velocity.z;
+			rehashParticle(index);
+		}
+
+		Vector3 getAcceleration(unsigned index) const {
+			return Vector3(accelerationX[index], accelerationY[index], accelerationZ[index]);
+		}
+
+		void setAcceleration(unsigned index, const Vector3& acceleration) {
+			accelerationX[index] = acceleration.x;
+			accelerationY[index] = acceleration.y;
+			accelerationZ[index] = acceleration.z;
+		}
+
+		void setInverseMass(unsigned index, real inverseMass) {
+			ParticleStore::inverseMass[index] = inverseMass;
+			mass[index] = inverseMass != 0 ? ((real)1.0) / inverseMass : 0;
+		}
+
+		void addForce(unsigned index, const Vector3& force) {
+			forceX[index] += force.x;
+			forceY[index] += force.y;
+			forceZ[index] += force.z;
+		}
+
+		void setAwake(unsigned index, bool awake = true) {
+			if (awake) {
+				// Nothing to do for particles already awake, addForce relies on it being cheap
+				if (!ParticleStore::awake[index]) {
+					ParticleStore::awake[index] = 1;
+					motion[index] = sleepEpsilon * 2;
+					rehashParticle(index);
+				}
+			}
+			else {
+				ParticleStore::awake[index] = 0;
+				velocityX[index] = 0;
+				velocityY[index] = 0;
+				velocityZ[index] = 0;
+				rehashParticle(index);
+			}
+		}
+
+		bool isAwake(unsigned index) const { return awake[index] != 0; }
+
+		void clearAccumulator(unsigned index) {
+			forceX[index] = 0;
+			forceY[index] = 0;
+			forceZ[index] = 0;
+		}
+	};
+}
+
+#endif// CYCLONE_PSTORE_H
\ No newline at end of file
@@ -0,0 +1,276 @@
+#ifndef CYCLONE_PWORLD_H
+#define CYCLONE_PWORLD_H
+
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "precision.h"
+#include "jobs.h"
+#include "parea.h"
+#include "particle.h"
+#include "pcontacts.h"
+#include "pfgen.h"
+#include "pnetwork.h"
+#include "pool.h"
+#include "pquery.h"
+#include "pstore.h"
+
+namespace cyclone {
+	class ParticleReplayRecorder;
+
+	// Keeps track of a set of particles and provides the means to update them all
+	class ParticleWorld {
+	public:
+		typedef std::vector<ParticleContactGenerator*> ContactGenerators;
+		typedef std::vector<ParticleSpringNetwork*> SpringNetworks;
+		typedef std::vector<ParticleForceGenerator*> ForceFields;
+		typedef std::vector<ParticleAreaForce*> AreaForces;
+
+		// Integration schemes of the step. The higher order ones call the force generators more than
+		// once per step, but stay stable with much larger steps on stiff springs
+		enum Integrator {
+			INTEGRATOR_EULER,            // Explicit Euler, one force evaluation per step (the default)
+			INTEGRATOR_SYMPLECTIC_EULER, // Semi-implicit Euler, one force evaluation per step
+			INTEGRATOR_VERLET,           // Velocity Verlet, two force evaluations per step
+			INTEGRATOR_RK4               // Runge-Kutta 4, four force evaluations per step
+		};
+
+	protected:
+		// Holds the particles owned by the world
+		ParticleStore particles;
+
+		// Holds the force generators for the particles in this world
+		ParticleForceRegistry registry;
+
+		// Holds the resolver for contacts
+		ParticleContactResolver resolver;
+
+		// Contact generators
+		ContactGenerators contactGenerators;
+
+		// Generators applied to every particle of the world, after the registry
+		ForceFields forceFields;
+
+		// Forces acting inside a volume, applied after the force fields to the particles they reach
+		AreaForces areaForces;
+
+		// Implicit spring networks, updated after the force generators
+		SpringNetworks springNetworks;
+
+		// Holds the list of contacts, its size is the max number of contacts per step
+		std::vector<ParticleContact> contacts;
+
+		// True if the resolver gets twice as many iterations as contacts at each step
+		bool calculateIterations;
+
+		real fixedStep; // Duration of a single simulation step
+		unsigned maxSubsteps; // Maximum number of steps taken by a single runPhysics call
+		real accumulator; // Elapsed time not simulated yet
+
+		// Job system used to run the step in parallel, null to run it on the calling thread
+		JobSystem* jobs;
+
+		Integrator integrator;
+
+		// Records the particles after each step, null when not recording
+		ParticleReplayRecorder* recorder;
+
+		// Spatial query over the particles, rebuilt at the end of each frame. queryDirty is set when
+		// the particles it indexes changed since its last update
+		ParticleQuery* query;
+		bool queryDirty;
+
+		// Per particle data of the Verlet and Runge-Kutta steps
+		std::vector<real> externalForceX, externalForceY, externalForceZ; // Forces added before the step
+		std::vector<position_real> startPositionX, startPositionY, startPositionZ;
+		std::vector<real> startVelocityX, startVelocityY, startVelocityZ;
+		std::vector<real> derivativeX, derivativeY, derivativeZ; // Verlet: acceleration at the start of the step
+		std::vector<real> sumVelocityX, sumVelocityY, sumVelocityZ; // RK4: weighted sums of the derivatives
+		std::vector<real> sumAccelerationX, sumAccelerationY, sumAccelerationZ;
+
+		// State of each particle over a Verlet or Runge-Kutta step, see isStepping. Only the particles
+		// awake at the start of the step have their start state saved, the ones woken by a force
+		// evaluation of the step start moving at the next one
+		std::vector<unsigned char> stepAwake;
+
+		// Pools of the built-in force generators, one per type so generators of a type are packed together
+		std::tuple<ObjectPool<ParticleGravity>, ObjectPool<ParticleDrag>, ObjectPool<ParticleSpring>,
+			ObjectPool<ParticleAnchoredSpring>, ObjectPool<ParticleBungee>, ObjectPool<ParticleBuoyancy>> generatorPools;
+
+		// Generators and registrations living until the next startFrame
+		FrameArena frameArena;
+		std::vector<ParticleForceRegistry::Handle> transientRegistrations;
+
+	public:
+		ParticleWorld(real fixedStep = ((real)1.0) / 60, unsigned maxSubsteps = 8, unsigned maxContacts = 1024, unsigned iterations = 0);
+
+		// Create a new particle owned by the world
+		Particle* createParticle();
+
+		// Destroy a particle owned by the world, together with its force registrations and spring links
+		void destroyParticle(Particle* particle);
+
+		// Return the particles of the world
+		ParticleStore& getParticles() { return particles; }
+		const ParticleStore& getParticles() const { return particles; }
+
+		// Create a built-in force generator from the pool of its type, without allocating once the pool
+		// has grown to its working size
+		template<class Generator, class... Args>
+		Generator* createGenerator(Args&&... args) {
+			return std::get<ObjectPool<Generator>>(generatorPools).create(std::forward<Args>(args)...);
+		}
+
+		// Return a generator made by createGenerator to its pool. Its registrations must have been removed
+		template<class Generator>
+		void destroyGenerator(Generator* generator) {
+			std::get<ObjectPool<Generator>>(generatorPools).destroy(generator);
+		}
+
+		// Make room for count generators of the given type
+		template<class Generator>
+		void reserveGenerators(unsigned count) {
+			std::get<ObjectPool<Generator>>(generatorPools).reserve(count);
+		}
+
+		// Create a force generator in the frame arena, released all at once by the next startFrame.
+		// Any trivially destructible generator type can be used
+		template<class Generator, class... Args>
+		Generator* createTransientGenerator(Args&&... args) {
+			return frameArena.create<Generator>(std::forward<Args>(args)...);
+		}
+
+		// Register a force for the current frame only, the next startFrame removes the registration
+		ParticleForceRegistry::Handle addTransientForce(Particle* particle, ParticleForceGenerator* fg);
+
+		// Return the force registry of the world
+		ParticleForceRegistry& getForceRegistry() { return registry; }
+		const ParticleForceRegistry& getForceRegistry() const { return registry; }
+
+		// Return the contact generators of the world
+		ContactGenerators& getContactGenerators() { return contactGenerators; }
+
+		// Return the force fields of the world. A field applies to all the particles through a single pass
+		// over the store (see ParticleForceGenerator::updateForces), much cheaper than registering a
+		// shared gravity or drag generator for each particle
+		ForceFields& getForceFields() { return forceFields; }
+
+		// Return the area forces of the world: explosions, wind, vortices. Each one only touches the
+		// particles inside its bounds, found through the query of the world if set (see setQuery), by
+		// testing every particle otherwise
+		AreaForces& getAreaForces() { return areaForces; }
+
+		// Return the spring networks of the world. They must be built on the particles of the world, and
+		// only work with INTEGRATOR_SYMPLECTIC_EULER: each network solves for the velocity change of one
+		// symplectic Euler step, which has no meaning inside the stages of the other schemes
+		SpringNetworks& getSpringNetworks() { return springNetworks; }
+
+		// Return the contact resolver of the world
+		ParticleContactResolver& getContactResolver() { return resolver; }
+
+		// Set the max number of contacts generated at each step
+		void setMaxContacts(unsigned maxContacts);
+		unsigned getMaxContacts() const { return (unsigned)contacts.size(); }
+
+		// Call each contact generator to report its contacts, return the number of contacts generated
+		unsigned generateContacts();
+
+		void setFixedStep(real fixedStep);
+		real getFixedStep() const { return fixedStep; }
+
+		void setMaxSubsteps(unsigned maxSubsteps);
+		unsigned getMaxSubsteps() const { return maxSubsteps; }
+
+		// Run the force update and the integration on the given job system (null to run serially).
+		// The parallel step gives bit-for-bit the same results as the serial one, whatever the number
+		// of threads: each particle gets its forces in the serial order and contacts are resolved serially
+		void setJobSystem(JobSystem* jobs) { ParticleWorld::jobs = jobs; }
+		JobSystem* getJobSystem() const { return jobs; }
+
+		// Select the integration scheme of the particles. A world with spring networks must use symplectic Euler
+		void setIntegrator(Integrator integrator);
+		Integrator getIntegrator() const { return integrator; }
+
+		// Record the particles after each step (null to stop). The recorder must be open
+		void setRecorder(ParticleReplayRecorder* recorder) { ParticleWorld::recorder = recorder; }
+		ParticleReplayRecorder* getRecorder() const { return recorder; }
+
+		// Spatial query used by the area forces (null to scan the particles instead). It must be built on
+		// the particles of the world. The world updates it once at the end of each runPhysics taking steps,
+		// not at each step, so the area forces of a step see the particles where the frame started them:
+		// the culling may be a frame late, the forces themselves use the current positions. The query is
+		// also up to date between frames, for the ray casts and sphere queries of the game. Particles
+		// created or destroyed in between are only added at the next step, call markParticlesChanged to
+		// query them before
+		void setQuery(ParticleQuery* query);
+		ParticleQuery* getQuery() const { return query; }
+
+		// Tell the world its particles changed outside of a step: restored from a snapshot, created or
+		// destroyed, or written directly in the store. The state hash is recomputed and the query, if any,
+		// rebuilt right away
+		void markParticlesChanged();
+
+		// Initialize the world for a simulation frame, clearing the force accumulators and releasing the
+		// transient forces of the last frame. Forces added after this call are applied to the first step
+		// of the next runPhysics
+		void startFrame();
+
+		// Advance the simulation by the given elapsed time in fixed steps, taking at most
+		// maxSubsteps steps (the time exceeding them is dropped). Returns the number of steps taken
+		unsigned runPhysics(real duration);
+
+		// Hash of the simulation state: the positions, velocities and sleep states of the particles and the
+		// time left in the accumulator. Two worlds fed the same inputs have the same hash after each frame,
+		// lockstep peers compare it to detect a desync. Once getParticles().setStateHashing(true) is called
+		// it is incremental: the step updates the hash of the particles it moves, and this call is constant
+		// time whatever their number. Without it, each call hashes all the particles
+		unsigned long long getStateHash() const;
+
+		// Elapsed time not simulated yet, saved and restored by the snapshots
+		real getAccumulator() const { return accumulator; }
+		void setAccumulator(real accumulator) { ParticleWorld::accumulator = accumulator; }
+
+		// Fraction of a step left in the accumulator, used to interpolate the rendered state
+		// between the last two steps
+		real getInterpolationAlpha() const { return accumulator / fixedStep; }
+
+	protected:
+		// Run a single fixed step: update the forces, integrate all the particles then resolve the contacts
+		void step(real duration);
+
+		// Call the force generators and the force fields, on the job system if any, then the spring networks
+		void updateForces(real duration);
+
+		// Apply the force fields to all the particles
+		void updateForceFields(real duration);
+
+		// Apply the area forces to the particles they reach, updating the query first if it is stale
+		void updateAreaForces(real duration);
+
+		// Run the job over all the particles, on the job system if any
+		void integrateParticles(const JobSystem::RangeJob& job);
+
+		// Save the forces added before the step, so each force evaluation starts from them, and the
+		// particles awake at its start
+		void saveExternalForces();
+
+		// True if the particle is moved by the current Verlet or Runge-Kutta step. A particle woken by the
+		// last force evaluation is not: its force so far is held in the external forces, to be applied
+		// at the next step like the force that wakes a particle between steps
+		bool isStepping(unsigned index);
+
+		// Give the particles woken during the step their held force back, then complete the step of
+		// the particles that moved
+		void completeStepRange(unsigned begin, unsigned end, real duration);
+
+		// Integration of the particles by the multi evaluation schemes
+		void stepVerlet(real duration);
+		void stepRungeKutta(real duration);
+
+		// Generate and resolve the contacts of the step, return the number of contacts
+		unsigned resolveContacts(real duration);
+	};
+}
+
+#endif// CYCLONE_PWORLD_H
\ No newline at end of file
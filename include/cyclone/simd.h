@@ -0,0 +1,48 @@
+#ifndef CYCLONE_SIMD_H
+#define CYCLONE_SIMD_H
+
+// Selects the SIMD backend used by the math kernels at compile time.
+// Define one of CYCLONE_SIMD_SCALAR, CYCLONE_SIMD_SSE or CYCLONE_SIMD_AVX2 to force a backend,
+// otherwise the widest instruction set enabled on the compiler command line is used.
+// Every backend evaluates the operations in the same order as the scalar code (no FMA),
+// so switching backend never changes the results.
+
+// The SIMD kernels work on single precision vectors
+#if defined(CYCLONE_DOUBLE_PRECISION)
+	#if defined(CYCLONE_SIMD_SSE) || defined(CYCLONE_SIMD_AVX2)
+		#error "The SSE and AVX2 backends need single precision reals"
+	#endif
+	#if !defined(CYCLONE_SIMD_SCALAR)
+		#define CYCLONE_SIMD_SCALAR
+	#endif
+#endif
+
+#if !defined(CYCLONE_SIMD_SCALAR) && !defined(CYCLONE_SIMD_SSE) && !defined(CYCLONE_SIMD_AVX2)
+	#if defined(__AVX2__)
+		#define CYCLONE_SIMD_AVX2
+	#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+		#define CYCLONE_SIMD_SSE
+	#else
+		#define CYCLONE_SIMD_SCALAR
+	#endif
+#endif
+
+// The AVX2 backend uses the SSE code for single vectors and 256 bit registers for batches
+#if defined(CYCLONE_SIMD_AVX2) && !defined(CYCLONE_SIMD_SSE)
+	#define CYCLONE_SIMD_SSE
+#endif
+
+#if defined(CYCLONE_SIMD_AVX2)
+	#include <immintrin.h>
+#elif defined(CYCLONE_SIMD_SSE)
+	#include <emmintrin.h>
+#endif
+
+#if defined(CYCLONE_SIMD_SSE)
+	// Alignment required to load a Vector3 in a single register
+	#define CYCLONE_ALIGN16 alignas(16)
+#else
+	#define CYCLONE_ALIGN16
+#endif
+
+#endif// CYCLONE_SIMD_H
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include "cyclone/core.h"
 #include "cyclone/pfgen.h"
 #include "cyclone/particle.h"
+#include "cyclone/pworld.h"
 #include <iostream>
 
 using namespace cyclone;
@@ -27,5 +28,21 @@ int main() {
 	ParticleSpring psB(&a, 1.0f, 2.0f);
 	registry.add(&b, &psB);
 
+	// ----- Test world -----
+	ParticleWorld world;
+	Particle* ball = world.createParticle();
+	ball->setMass(2.0f);
+	ball->setDamping(0.99f);
+	ball->setVelocity(Vector3(0, 10, 0));
+
+	ParticleGravity gravity(Vector3(0, -9.81f, 0));
+	world.getForceRegistry().add(ball, &gravity);
+
+	world.startFrame();
+	world.runPhysics(0.5f);
+
+	Vector3 ballPosition = ball->getPosition();
+	std::cout << "Ball: (" << ballPosition.x << ", " << ballPosition.y << ", " << ballPosition.z << ")" << std::endl;
+
 	return 0;
 }
\ No newline at end of file
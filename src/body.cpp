@@ -0,0 +1,239 @@
+#include <assert.h>
+#include "cyclone/body.h"
+
+using namespace cyclone;
+
+namespace {
+	// Inertia tensor transform by a quaternion: iitWorld = R * iitBody * R^T
+	inline void transformInertiaTensor(Matrix3& iitWorld, const Matrix3& iitBody, const Matrix4& rotmat) {
+		real t4 = rotmat.data[0] * iitBody.data[0] + rotmat.data[1] * iitBody.data[3] + rotmat.data[2] * iitBody.data[6];
+		real t9 = rotmat.data[0] * iitBody.data[1] + rotmat.data[1] * iitBody.data[4] + rotmat.data[2] * iitBody.data[7];
+		real t14 = rotmat.data[0] * iitBody.data[2] + rotmat.data[1] * iitBody.data[5] + rotmat.data[2] * iitBody.data[8];
+		real t28 = rotmat.data[4] * iitBody.data[0] + rotmat.data[5] * iitBody.data[3] + rotmat.data[6] * iitBody.data[6];
+		real t33 = rotmat.data[4] * iitBody.data[1] + rotmat.data[5] * iitBody.data[4] + rotmat.data[6] * iitBody.data[7];
+		real t38 = rotmat.data[4] * iitBody.data[2] + rotmat.data[5] * iitBody.data[5] + rotmat.data[6] * iitBody.data[8];
+		real t52 = rotmat.data[8] * iitBody.data[0] + rotmat.data[9] * iitBody.data[3] + rotmat.data[10] * iitBody.data[6];
+		real t57 = rotmat.data[8] * iitBody.data[1] + rotmat.data[9] * iitBody.data[4] + rotmat.data[10] * iitBody.data[7];
+		real t62 = rotmat.data[8] * iitBody.data[2] + rotmat.data[9] * iitBody.data[5] + rotmat.data[10] * iitBody.data[8];
+
+		iitWorld.data[0] = t4 * rotmat.data[0] + t9 * rotmat.data[1] + t14 * rotmat.data[2];
+		iitWorld.data[1] = t4 * rotmat.data[4] + t9 * rotmat.data[5] + t14 * rotmat.data[6];
+		iitWorld.data[2] = t4 * rotmat.data[8] + t9 * rotmat.data[9] + t14 * rotmat.data[10];
+		iitWorld.data[3] = t28 * rotmat.data[0] + t33 * rotmat.data[1] + t38 * rotmat.data[2];
+		iitWorld.data[4] = t28 * rotmat.data[4] + t33 * rotmat.data[5] + t38 * rotmat.data[6];
+		iitWorld.data[5] = t28 * rotmat.data[8] + t33 * rotmat.data[9] + t38 * rotmat.data[10];
+		iitWorld.data[6] = t52 * rotmat.data[0] + t57 * rotmat.data[1] + t62 * rotmat.data[2];
+		iitWorld.data[7] = t52 * rotmat.data[4] + t57 * rotmat.data[5] + t62 * rotmat.data[6];
+		iitWorld.data[8] = t52 * rotmat.data[8] + t57 * rotmat.data[9] + t62 * rotmat.data[10];
+	}
+}
+
+RigidBody::RigidBody() : inverseMass(1), linearDamping(1), angularDamping(1), linearDampingFactor(1), angularDampingFactor(1),
+	derivedDataDirty(true), motion(sleepEpsilon * 2), sleepBias(1), dampingDuration(0), isAwake(true), canSleep(false)
+{
+	// Unit sphere-like inertia by default
+	inverseInertiaTensor = Matrix3(1, 0, 0, 0, 1, 0, 0, 0, 1);
+}
+
+void RigidBody::updateDerivedData() const {
+	transformMatrix.setorientationAndPos(orientation, position);
+	transformInertiaTensor(inverseInertiaTensorWorld, inverseInertiaTensor, transformMatrix);
+	derivedDataDirty = false;
+}
+
+void RigidBody::calculateDerivedData(RigidBody* bodies, unsigned count) {
+	// Bodies at rest since the last call are skipped, the others are done back to back
+	for (unsigned i = 0; i < count; ++i) {
+		if (bodies[i].derivedDataDirty) {
+			bodies[i].updateDerivedData();
+		}
+	}
+}
+
+void RigidBody::integrate(real duration) {
+	assert(duration > 0.0);
+
+	// Sleeping bodies do not move
+	if (!isAwake) {
+		return;
+	}
+
+	// The world inverse inertia tensor must match the current orientation
+	calculateDerivedData();
+
+	// Linear acceleration from force inputs
+	lastFrameAcceleration = acceleration;
+	lastFrameAcceleration.AddScaledVector(forceAccum, inverseMass);
+
+	// Angular acceleration from torque inputs
+	Vector3 angularAcceleration = inverseInertiaTensorWorld.transform(torqueAccum);
+
+	// Update linear and angular velocity
+	velocity.AddScaledVector(lastFrameAcceleration, duration);
+	rotation.AddScaledVector(angularAcceleration, duration);
+
+	// Drag. The factors only change with the damping and the duration, usually fixed
+	if (duration != dampingDuration) {
+		linearDampingFactor = real_pow(linearDamping, duration);
+		angularDampingFactor = real_pow(angularDamping, duration);
+		sleepBias = real_pow(((real)0.5), duration);
+		dampingDuration = duration;
+	}
+	velocity *= linearDampingFactor;
+	rotation *= angularDampingFactor;
+
+	// Update linear and angular position
+	position.AddScaledVector(velocity, duration);
+	orientation.addScaledVector(rotation, duration);
+	orientation.normalize();
+
+	// The derived data is rebuilt on the next use
+	derivedDataDirty = true;
+
+	clearAccumulators();
+
+	// Update the kinetic energy average and put the body to sleep if it is at rest
+	if (canSleep) {
+		real currentMotion = velocity.ScalarProduct(velocity) + rotation.ScalarProduct(rotation);
+		motion = sleepBias * motion + (1 - sleepBias) * currentMotion;
+
+		if (motion < sleepEpsilon) {
+			setAwake(false);
+		}
+		else if (motion > 10 * sleepEpsilon) {
+			motion = 10 * sleepEpsilon;
+		}
+	}
+}
+
+void RigidBody::setAwake(const bool awake) {
+	if (awake) {
+		isAwake = true;
+
+		// Add a bit of motion to avoid it falling asleep immediately
+		motion = sleepEpsilon * 2.0f;
+	}
+	else {
+		isAwake = false;
+		velocity.clear();
+		rotation.clear();
+	}
+}
+
+void RigidBody::setCanSleep(const bool canSleep) {
+	RigidBody::canSleep = canSleep;
+
+	if (!canSleep && !isAwake) {
+		setAwake();
+	}
+}
+
+void RigidBody::setMass(const real mass) {
+	assert(mass != 0);
+	inverseMass = ((real)1.0) / mass;
+}
+
+real RigidBody::getMass() const {
+	if (inverseMass == 0) {
+		return REAL_MAX;
+	}
+	return ((real)1.0) / inverseMass;
+}
+
+void RigidBody::setInverseMass(const real inverseMass) {
+	RigidBody::inverseMass = inverseMass;
+}
+
+void RigidBody::setInertiaTensor(const Matrix3& inertiaTensor) {
+	inverseInertiaTensor.setInverse(inertiaTensor);
+	derivedDataDirty = true;
+}
+
+void RigidBody::setInverseInertiaTensor(const Matrix3& inverseInertiaTensor) {
+	RigidBody::inverseInertiaTensor = inverseInertiaTensor;
+	derivedDataDirty = true;
+}
+
+Matrix3 RigidBody::getInverseInertiaTensorWorld() const {
+	calculateDerivedData();
+	return inverseInertiaTensorWorld;
+}
+
+void RigidBody::setDamping(const real linearDamping, const real angularDamping) {
+	RigidBody::linearDamping = linearDamping;
+	RigidBody::angularDamping = angularDamping;
+	dampingDuration = 0;
+}
+
+void RigidBody::setPosition(const Vector3& position) {
+	RigidBody::position = position;
+	derivedDataDirty = true;
+}
+
+void RigidBody::setOrientation(const Quaternion& orientation) {
+	RigidBody::orientation = orientation;
+	RigidBody::orientation.normalize();
+	derivedDataDirty = true;
+}
+
+const Matrix4& RigidBody::getTransform() const {
+	calculateDerivedData();
+	return transformMatrix;
+}
+
+Vector3 RigidBody::getPointInWorldSpace(const Vector3& point) const {
+	return getTransform().transform(point);
+}
+
+Vector3 RigidBody::getPointInLocalSpace(const Vector3& point) const {
+	return getTransform().transformInverse(point);
+}
+
+Vector3 RigidBody::getDirectionInWorldSpace(const Vector3& direction) const {
+	return getTransform().transformDirection(direction);
+}
+
+Vector3 RigidBody::getDirectionInLocalSpace(const Vector3& direction) const {
+	// The inverse of a rotation is its transpose
+	const Matrix4& transform = getTransform();
+	return Vector3(
+		direction.x * transform.data[0] + direction.y * transform.data[4] + direction.z * transform.data[8],
+		direction.x * transform.data[1] + direction.y * transform.data[5] + direction.z * transform.data[9],
+		direction.x * transform.data[2] + direction.y * transform.data[6] + direction.z * transform.data[10]
+	);
+}
+
+void RigidBody::clearAccumulators() {
+	forceAccum.clear();
+	torqueAccum.clear();
+}
+
+void RigidBody::addForce(const Vector3& force) {
+	forceAccum += force;
+	if (!isAwake) {
+		setAwake();
+	}
+}
+
+void RigidBody::addForceAtPoint(const Vector3& force, const Vector3& point) {
+	// Point relative to the center of mass
+	Vector3 pt = point;
+	pt -= position;
+
+	forceAccum += force;
+	torqueAccum += pt % force;
+	if (!isAwake) {
+		setAwake();
+	}
+}
+
+void RigidBody::addForceAtBodyPoint(const Vector3& force, const Vector3& point) {
+	addForceAtPoint(force, getPointInWorldSpace(point));
+}
+
+void RigidBody::addTorque(const Vector3& torque) {
+	torqueAccum += torque;
+	if (!isAwake) {
+		setAwake();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,310 @@
+#include <assert.h>
+#include "cyclone/collide_coarse.h"
+
+using namespace cyclone;
+
+namespace {
+	// Return the second operand when the first is NaN
+	real minReal(real a, real b) { return a < b ? a : b; }
+	real maxReal(real a, real b) { return a > b ? a : b; }
+	int maxInt(int a, int b) { return a > b ? a : b; }
+}
+
+BoundingBox::BoundingBox(const BoundingBox& one, const BoundingBox& two) :
+	minimum(minReal(one.minimum.x, two.minimum.x), minReal(one.minimum.y, two.minimum.y), minReal(one.minimum.z, two.minimum.z)),
+	maximum(maxReal(one.maximum.x, two.maximum.x), maxReal(one.maximum.y, two.maximum.y), maxReal(one.maximum.z, two.maximum.z))
+{
+}
+
+real BoundingBox::getSize() const {
+	Vector3 extent = maximum - minimum;
+	return 2 * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+real BoundingBox::getGrowth(const BoundingBox& other) const {
+	return BoundingBox(*this, other).getSize() - getSize();
+}
+
+bool BoundingBox::intersectsRay(const Vector3& origin, const Vector3& inverseDirection, real maxDistance, real& distance) const {
+	// Slab test: clip [0, maxDistance] against the entry and exit of the ray on each axis. A ray along
+	// a face gives 0 * inf = NaN, the comparisons then keep the other operand
+	real entry = 0;
+	real exit = maxDistance;
+
+	real t1 = (minimum.x - origin.x) * inverseDirection.x;
+	real t2 = (maximum.x - origin.x) * inverseDirection.x;
+	entry = maxReal(minReal(t1, t2), entry);
+	exit = minReal(maxReal(t1, t2), exit);
+
+	t1 = (minimum.y - origin.y) * inverseDirection.y;
+	t2 = (maximum.y - origin.y) * inverseDirection.y;
+	entry = maxReal(minReal(t1, t2), entry);
+	exit = minReal(maxReal(t1, t2), exit);
+
+	t1 = (minimum.z - origin.z) * inverseDirection.z;
+	t2 = (maximum.z - origin.z) * inverseDirection.z;
+	entry = maxReal(minReal(t1, t2), entry);
+	exit = minReal(maxReal(t1, t2), exit);
+
+	distance = entry;
+	return entry <= exit;
+}
+
+BoundingBoxTree::BoundingBoxTree(real margin, real displacementMultiplier) :
+	root(NULL_NODE), freeList(NULL_NODE), proxyCount(0), margin(margin), displacementMultiplier(displacementMultiplier)
+{
+}
+
+void BoundingBoxTree::reserve(unsigned count) {
+	// A tree of n leaves has n - 1 internal nodes
+	nodes.reserve(count > 0 ? 2 * count - 1 : 0);
+}
+
+unsigned BoundingBoxTree::allocateNode() {
+	unsigned node;
+	if (freeList != NULL_NODE) {
+		node = freeList;
+		freeList = nodes[node].parent;
+	}
+	else {
+		node = (unsigned)nodes.size();
+		nodes.push_back(Node());
+	}
+
+	Node& n = nodes[node];
+	n.body = 0;
+	n.parent = NULL_NODE;
+	n.child[0] = n.child[1] = NULL_NODE;
+	n.height = 0;
+	return node;
+}
+
+void BoundingBoxTree::freeNode(unsigned node) {
+	nodes[node].parent = freeList;
+	nodes[node].height = -1;
+	freeList = node;
+}
+
+unsigned BoundingBoxTree::createProxy(const BoundingBox& box, RigidBody* body) {
+	unsigned proxy = allocateNode();
+	Vector3 fat(margin, margin, margin);
+	nodes[proxy].box = BoundingBox(box.minimum - fat, box.maximum + fat);
+	nodes[proxy].body = body;
+	insertLeaf(proxy);
+	++proxyCount;
+	return proxy;
+}
+
+void BoundingBoxTree::destroyProxy(unsigned proxy) {
+	assert(proxy < nodes.size() && nodes[proxy].height == 0);
+	removeLeaf(proxy);
+	freeNode(proxy);
+	--proxyCount;
+}
+
+bool BoundingBoxTree::moveProxy(unsigned proxy, const BoundingBox& box, const Vector3& displacement) {
+	assert(proxy < nodes.size() && nodes[proxy].height == 0);
+	if (nodes[proxy].box.contains(box)) {
+		return false;
+	}
+
+	// Enlarge the box by the margin, and further ahead of the motion so a steadily moving body does
+	// not leave its fat box at every step
+	Vector3 fat(margin, margin, margin);
+	BoundingBox fatBox(box.minimum - fat, box.maximum + fat);
+	Vector3 ahead = displacement * displacementMultiplier;
+	if (ahead.x < 0) fatBox.minimum.x += ahead.x; else fatBox.maximum.x += ahead.x;
+	if (ahead.y < 0) fatBox.minimum.y += ahead.y; else fatBox.maximum.y += ahead.y;
+	if (ahead.z < 0) fatBox.minimum.z += ahead.z; else fatBox.maximum.z += ahead.z;
+
+	removeLeaf(proxy);
+	nodes[proxy].box = fatBox;
+	insertLeaf(proxy);
+	return true;
+}
+
+void BoundingBoxTree::insertLeaf(unsigned leaf) {
+	if (root == NULL_NODE) {
+		root = leaf;
+		nodes[leaf].parent = NULL_NODE;
+		return;
+	}
+
+	// Walk down to the best sibling: at each node either pair the leaf with the whole subtree, or go
+	// into the child whose box grows the least, paying for the growth of this node on the way
+	BoundingBox leafBox = nodes[leaf].box;
+	unsigned index = root;
+	while (!nodes[index].isLeaf()) {
+		const Node& node = nodes[index];
+		real size = node.box.getSize();
+		real combinedSize = BoundingBox(node.box, leafBox).getSize();
+
+		real cost = 2 * combinedSize;
+		real inheritanceCost = 2 * (combinedSize - size);
+
+		real childCost[2];
+		for (unsigned c = 0; c < 2; ++c) {
+			const Node& child = nodes[node.child[c]];
+			childCost[c] = inheritanceCost + (child.isLeaf() ? BoundingBox(leafBox, child.box).getSize() : child.box.getGrowth(leafBox));
+		}
+
+		if (cost < childCost[0] && cost < childCost[1]) {
+			break;
+		}
+		index = childCost[0] < childCost[1] ? node.child[0] : node.child[1];
+	}
+	unsigned sibling = index;
+
+	// New parent of the sibling and the leaf
+	unsigned oldParent = nodes[sibling].parent;
+	unsigned newParent = allocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].box = BoundingBox(leafBox, nodes[sibling].box);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].child[0] = sibling;
+	nodes[newParent].child[1] = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent == NULL_NODE) {
+		root = newParent;
+	}
+	else if (nodes[oldParent].child[0] == sibling) {
+		nodes[oldParent].child[0] = newParent;
+	}
+	else {
+		nodes[oldParent].child[1] = newParent;
+	}
+
+	refit(oldParent);
+}
+
+void BoundingBoxTree::removeLeaf(unsigned leaf) {
+	if (leaf == root) {
+		root = NULL_NODE;
+		return;
+	}
+
+	// The sibling takes the place of the parent
+	unsigned parent = nodes[leaf].parent;
+	unsigned grandParent = nodes[parent].parent;
+	unsigned sibling = nodes[parent].child[0] == leaf ? nodes[parent].child[1] : nodes[parent].child[0];
+	freeNode(parent);
+
+	nodes[sibling].parent = grandParent;
+	if (grandParent == NULL_NODE) {
+		root = sibling;
+		return;
+	}
+	if (nodes[grandParent].child[0] == parent) {
+		nodes[grandParent].child[0] = sibling;
+	}
+	else {
+		nodes[grandParent].child[1] = sibling;
+	}
+	refit(grandParent);
+}
+
+void BoundingBoxTree::refit(unsigned node) {
+	while (node != NULL_NODE) {
+		node = balance(node);
+
+		Node& n = nodes[node];
+		const Node& one = nodes[n.child[0]];
+		const Node& two = nodes[n.child[1]];
+		n.height = 1 + maxInt(one.height, two.height);
+		n.box = BoundingBox(one.box, two.box);
+
+		node = n.parent;
+	}
+}
+
+unsigned BoundingBoxTree::balance(unsigned a) {
+	Node& nodeA = nodes[a];
+	if (nodeA.isLeaf()) {
+		return a;
+	}
+
+	int heightDifference = nodes[nodeA.child[1]].height - nodes[nodeA.child[0]].height;
+	if (heightDifference >= -1 && heightDifference <= 1) {
+		return a;
+	}
+
+	// Promote the taller child u in place of a. The taller grandchild stays under u, the other one
+	// goes under a in place of u
+	unsigned up = heightDifference > 1 ? 1 : 0;
+	unsigned u = nodeA.child[up];
+	unsigned s = nodeA.child[1 - up];
+	Node& nodeU = nodes[u];
+	unsigned f = nodeU.child[0];
+	unsigned g = nodeU.child[1];
+	if (nodes[f].height < nodes[g].height) {
+		unsigned swap = f;
+		f = g;
+		g = swap;
+	}
+
+	nodeU.child[0] = a;
+	nodeU.child[1] = f;
+	nodeU.parent = nodeA.parent;
+	nodeA.parent = u;
+	if (nodeU.parent == NULL_NODE) {
+		root = u;
+	}
+	else if (nodes[nodeU.parent].child[0] == a) {
+		nodes[nodeU.parent].child[0] = u;
+	}
+	else {
+		nodes[nodeU.parent].child[1] = u;
+	}
+
+	nodeA.child[up] = g;
+	nodes[g].parent = a;
+	nodeA.box = BoundingBox(nodes[s].box, nodes[g].box);
+	nodeA.height = 1 + maxInt(nodes[s].height, nodes[g].height);
+	nodeU.box = BoundingBox(nodeA.box, nodes[f].box);
+	nodeU.height = 1 + maxInt(nodeA.height, nodes[f].height);
+	return u;
+}
+
+void BoundingBoxTree::findPairs(std::vector<PotentialContact>& pairs) const {
+	if (root != NULL_NODE) {
+		findPairs(root, pairs);
+	}
+}
+
+void BoundingBoxTree::findPairs(unsigned node, std::vector<PotentialContact>& pairs) const {
+	const Node& n = nodes[node];
+	if (n.isLeaf()) {
+		return;
+	}
+
+	// Pairs within each child, then across the two
+	findPairs(n.child[0], pairs);
+	findPairs(n.child[1], pairs);
+	findPairs(n.child[0], n.child[1], pairs);
+}
+
+void BoundingBoxTree::findPairs(unsigned one, unsigned two, std::vector<PotentialContact>& pairs) const {
+	const Node& nodeOne = nodes[one];
+	const Node& nodeTwo = nodes[two];
+	if (!nodeOne.box.overlaps(nodeTwo.box)) {
+		return;
+	}
+
+	if (nodeOne.isLeaf() && nodeTwo.isLeaf()) {
+		PotentialContact contact;
+		contact.body[0] = nodeOne.body;
+		contact.body[1] = nodeTwo.body;
+		pairs.push_back(contact);
+	}
+	// Descend into the larger volume, as the book's BVHNode does, unless it is a leaf
+	else if (nodeTwo.isLeaf() || (!nodeOne.isLeaf() && nodeOne.box.getSize() >= nodeTwo.box.getSize())) {
+		findPairs(nodeOne.child[0], two, pairs);
+		findPairs(nodeOne.child[1], two, pairs);
+	}
+	else {
+		findPairs(one, nodeTwo.child[0], pairs);
+		findPairs(one, nodeTwo.child[1], pairs);
+	}
+}
\ No newline at end of file
@@ -2,6 +2,17 @@
 
 using namespace cyclone;
 
+// Default sleep epsilon, from the book
+real cyclone::sleepEpsilon = ((real)0.3);
+
+void cyclone::setSleepEpsilon(real value) {
+	cyclone::sleepEpsilon = value;
+}
+
+real cyclone::getSleepEpsilon() {
+	return cyclone::sleepEpsilon;
+}
+
 real Matrix4::getDeterminant() const {
 	return
 		-data[8] * data[5] * data[2] +
@@ -49,4 +60,138 @@ void Matrix4::setInverse(const Matrix4& m) {
 		+ m.data[0] * m.data[9] * m.data[7]
 		+ m.data[4] * m.data[1] * m.data[11]
 		- m.data[0] * m.data[5] * m.data[11]) * det;
+}
+
+#if defined(CYCLONE_SIMD_SSE)
+namespace {
+	// Computes c0 * x + c1 * y + c2 * z, adding c3 when Translate is set, for each vector. When Subtract is
+	// set the offset is subtracted from the vector first. This is the operation order of the single vector
+	// functions of Matrix4, so the batch functions give the same results
+	template<bool Translate, bool Subtract>
+	void transformBatch(const __m128* c, __m128 offset, const Vector3* in, Vector3* out, unsigned count) {
+		unsigned i = 0;
+#if defined(CYCLONE_SIMD_AVX2)
+		// Two vectors per register, one in each 128 bit lane
+		__m256 c0 = _mm256_broadcast_ps(&c[0]);
+		__m256 c1 = _mm256_broadcast_ps(&c[1]);
+		__m256 c2 = _mm256_broadcast_ps(&c[2]);
+		__m256 c3 = Translate ? _mm256_broadcast_ps(&c[3]) : _mm256_setzero_ps();
+		__m256 offset8 = _mm256_broadcast_ps(&offset);
+		for (; i + 2 <= count; i += 2) {
+			__m256 v = _mm256_loadu_ps(&in[i].x);
+			if (Subtract) {
+				v = _mm256_sub_ps(v, offset8);
+			}
+			__m256 result = _mm256_mul_ps(c0, _mm256_permute_ps(v, _MM_SHUFFLE(0, 0, 0, 0)));
+			result = _mm256_add_ps(result, _mm256_mul_ps(c1, _mm256_permute_ps(v, _MM_SHUFFLE(1, 1, 1, 1))));
+			result = _mm256_add_ps(result, _mm256_mul_ps(c2, _mm256_permute_ps(v, _MM_SHUFFLE(2, 2, 2, 2))));
+			if (Translate) {
+				result = _mm256_add_ps(result, c3);
+			}
+			_mm256_storeu_ps(&out[i].x, result);
+		}
+#endif
+		for (; i < count; ++i) {
+			__m128 v = in[i].load();
+			if (Subtract) {
+				v = _mm_sub_ps(v, offset);
+			}
+			__m128 result = _mm_mul_ps(c[0], _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+			result = _mm_add_ps(result, _mm_mul_ps(c[1], _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+			result = _mm_add_ps(result, _mm_mul_ps(c[2], _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+			if (Translate) {
+				result = _mm_add_ps(result, c[3]);
+			}
+			_mm_store_ps(&out[i].x, result);
+		}
+	}
+}
+#endif
+
+void Matrix4::transformPoints(const Vector3* in, Vector3* out, unsigned count) const {
+#if defined(CYCLONE_SIMD_SSE)
+	__m128 c[4];
+	loadColumns(c);
+	transformBatch<true, false>(c, _mm_setzero_ps(), in, out, count);
+#else
+	for (unsigned i = 0; i < count; ++i) {
+		out[i] = (*this) * in[i];
+	}
+#endif
+}
+
+void Matrix4::transformDirections(const Vector3* in, Vector3* out, unsigned count) const {
+#if defined(CYCLONE_SIMD_SSE)
+	__m128 c[4];
+	loadColumns(c);
+	transformBatch<false, false>(c, _mm_setzero_ps(), in, out, count);
+#else
+	for (unsigned i = 0; i < count; ++i) {
+		out[i] = transformDirection(in[i]);
+	}
+#endif
+}
+
+void Matrix4::transformInversePoints(const Vector3* in, Vector3* out, unsigned count) const {
+#if defined(CYCLONE_SIMD_SSE)
+	__m128 r[3];
+	loadInverseColumns(r);
+	transformBatch<false, true>(r, _mm_set_ps(0, data[11], data[7], data[3]), in, out, count);
+#else
+	for (unsigned i = 0; i < count; ++i) {
+		out[i] = transformInverse(in[i]);
+	}
+#endif
+}
+
+void Matrix4::transformInverseDirections(const Vector3* in, Vector3* out, unsigned count) const {
+#if defined(CYCLONE_SIMD_SSE)
+	__m128 r[3];
+	loadInverseColumns(r);
+	transformBatch<false, false>(r, _mm_setzero_ps(), in, out, count);
+#else
+	for (unsigned i = 0; i < count; ++i) {
+		out[i] = transformInverseDirection(in[i]);
+	}
+#endif
+}
+
+void cyclone::normalizeVectors(Vector3* vectors, unsigned count) {
+	unsigned i = 0;
+#if defined(CYCLONE_SIMD_SSE)
+#if defined(CYCLONE_SIMD_AVX2)
+	__m256 one8 = _mm256_set1_ps(1.0f);
+	__m256 zero8 = _mm256_setzero_ps();
+	for (; i + 2 <= count; i += 2) {
+		__m256 v = _mm256_loadu_ps(&vectors[i].x);
+		__m256 sq = _mm256_mul_ps(v, v);
+
+		// Same summation order as Vector3::magnitude
+		__m256 sum = _mm256_add_ps(_mm256_permute_ps(sq, _MM_SHUFFLE(0, 0, 0, 0)), _mm256_permute_ps(sq, _MM_SHUFFLE(1, 1, 1, 1)));
+		sum = _mm256_add_ps(sum, _mm256_permute_ps(sq, _MM_SHUFFLE(2, 2, 2, 2)));
+		__m256 length = _mm256_sqrt_ps(sum);
+
+		__m256 scaled = _mm256_mul_ps(v, _mm256_div_ps(one8, length));
+		__m256 mask = _mm256_cmp_ps(length, zero8, _CMP_GT_OQ);
+		_mm256_storeu_ps(&vectors[i].x, _mm256_blendv_ps(v, scaled, mask));
+	}
+#endif
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 zero = _mm_setzero_ps();
+	for (; i < count; ++i) {
+		__m128 v = vectors[i].load();
+		__m128 sq = _mm_mul_ps(v, v);
+		__m128 sum = _mm_add_ps(_mm_shuffle_ps(sq, sq, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(1, 1, 1, 1)));
+		sum = _mm_add_ps(sum, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(2, 2, 2, 2)));
+		__m128 length = _mm_sqrt_ps(sum);
+
+		__m128 scaled = _mm_mul_ps(v, _mm_div_ps(one, length));
+		__m128 mask = _mm_cmpgt_ps(length, zero);
+		_mm_store_ps(&vectors[i].x, _mm_or_ps(_mm_and_ps(mask, scaled), _mm_andnot_ps(mask, v)));
+	}
+#else
+	for (; i < count; ++i) {
+		vectors[i].normalize();
+	}
+#endif
 }
\ No newline at end of file
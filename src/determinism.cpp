@@ -0,0 +1,145 @@
+#include <assert.h>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include "cyclone/determinism.h"
+
+using namespace cyclone;
+
+namespace {
+	const double LN2 = 0.69314718055994530942;
+
+	// ln2 split so k * LN2_HIGH is exact for the k of any finite double result
+	const double LN2_HIGH = 6.93147180369123816490e-01;
+	const double LN2_LOW = 1.90821492927058770002e-10;
+
+	// Natural log of x > 0. frexp is exact, the series in s = (m - 1) / (m + 1) converges below 1e-17
+	double deterministicLog(double x) {
+		int exponent;
+		double m = std::frexp(x, &exponent);
+		if (m < 0.70710678118654752440) {
+			m *= 2;
+			--exponent;
+		}
+
+		double s = (m - 1) / (m + 1);
+		double s2 = s * s;
+		double series = 1.0 / 23;
+		for (int n = 21; n >= 1; n -= 2) {
+			series = series * s2 + 1.0 / n;
+		}
+		return exponent * LN2 + 2 * s * series;
+	}
+
+	// e^x, split as 2^k e^r with |r| <= ln2 / 2. ldexp is exact, over and underflow included
+	double deterministicExp(double x) {
+		double k = std::floor(x / LN2 + 0.5);
+		double r = (x - k * LN2_HIGH) - k * LN2_LOW;
+
+		double series = 1;
+		for (int n = 17; n >= 1; --n) {
+			series = series * r / n + 1;
+		}
+		return std::ldexp(series, (int)k);
+	}
+
+	const unsigned long long PRIME1 = 0x9E3779B185EBCA87ull;
+	const unsigned long long PRIME2 = 0xC2B2AE3D27D4EB4Full;
+	const unsigned long long PRIME3 = 0x165667B19E3779F9ull;
+
+	unsigned long long rotate(unsigned long long value, int bits) {
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	unsigned long long mix(unsigned long long lane, unsigned long long word) {
+		return rotate(lane + word * PRIME2, 31) * PRIME1;
+	}
+
+	// Little endian word, whatever the byte order of the machine
+	unsigned long long readWord(const unsigned char* data) {
+		unsigned long long word = 0;
+		for (int b = 7; b >= 0; --b) {
+			word = (word << 8) | data[b];
+		}
+		return word;
+	}
+}
+
+double cyclone::deterministicPow(double base, double exponent) {
+	assert(base >= 0);
+	if (exponent == 0 || base == 1) {
+		return 1;
+	}
+	if (base == 0) {
+		return exponent > 0 ? 0 : std::numeric_limits<double>::infinity();
+	}
+	return deterministicExp(exponent * deterministicLog(base));
+}
+
+StateHash::StateHash(unsigned long long seed) : bufferSize(0), length(0) {
+	lanes[0] = seed + PRIME1 + PRIME2;
+	lanes[1] = seed + PRIME2;
+	lanes[2] = seed;
+	lanes[3] = seed - PRIME1;
+}
+
+void StateHash::round(const unsigned char* data) {
+	for (unsigned l = 0; l < 4; ++l) {
+		lanes[l] = mix(lanes[l], readWord(data + l * 8));
+	}
+}
+
+void StateHash::add(const void* data, size_t size) {
+	// Empty vectors may give a null pointer, which memcpy must not see even for zero bytes
+	if (size == 0) {
+		return;
+	}
+
+	const unsigned char* bytes = (const unsigned char*)data;
+	length += size;
+
+	// Complete the pending round
+	if (bufferSize > 0) {
+		size_t take = 32 - bufferSize < size ? 32 - bufferSize : size;
+		std::memcpy(buffer + bufferSize, bytes, take);
+		bufferSize += (unsigned)take;
+		bytes += take;
+		size -= take;
+		if (bufferSize < 32) {
+			return;
+		}
+		round(buffer);
+		bufferSize = 0;
+	}
+
+	for (; size >= 32; bytes += 32, size -= 32) {
+		round(bytes);
+	}
+
+	std::memcpy(buffer, bytes, size);
+	bufferSize = (unsigned)size;
+}
+
+unsigned long long StateHash::get() const {
+	unsigned long long hash = rotate(lanes[0], 1) + rotate(lanes[1], 7) + rotate(lanes[2], 12) + rotate(lanes[3], 18);
+	hash += length;
+
+	// Remaining bytes, a word at a time then byte by byte
+	unsigned i = 0;
+	for (; i + 8 <= bufferSize; i += 8) {
+		hash ^= mix(0, readWord(buffer + i));
+		hash = rotate(hash, 27) * PRIME1 + PRIME3;
+	}
+	for (; i < bufferSize; ++i) {
+		hash ^= buffer[i] * PRIME3;
+		hash = rotate(hash, 11) * PRIME1;
+	}
+
+	// Final avalanche
+	hash ^= hash >> 33;
+	hash *= PRIME2;
+	hash ^= hash >> 29;
+	hash *= PRIME3;
+	hash ^= hash >> 32;
+	return hash;
+}
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include <assert.h>
+#include "cyclone/jobs.h"
+
+using namespace cyclone;
+
+namespace {
+	// Job system and queue of the current thread when it is a worker
+	thread_local const JobSystem* currentSystem = 0;
+	thread_local unsigned currentQueue = 0;
+}
+
+JobSystem::JobSystem(unsigned threadCount) : queuedTasks(0), stopping(false) {
+	if (threadCount == 0) {
+		threadCount = std::thread::hardware_concurrency();
+	}
+	if (threadCount == 0) {
+		threadCount = 1;
+	}
+
+	// The last queue is shared by the threads outside the pool
+	for (unsigned i = 0; i < threadCount; ++i) {
+		queues.push_back(new Queue());
+	}
+	for (unsigned i = 0; i + 1 < threadCount; ++i) {
+		workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+	}
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	wakeUp.notify_all();
+	for (unsigned i = 0; i < workers.size(); ++i) {
+		workers[i].join();
+	}
+	for (unsigned i = 0; i < queues.size(); ++i) {
+		delete queues[i];
+	}
+}
+
+unsigned JobSystem::getQueueIndex() const {
+	if (currentSystem == this) {
+		return currentQueue;
+	}
+	return (unsigned)queues.size() - 1;
+}
+
+bool JobSystem::findTask(unsigned queueIndex, Task& task) {
+	// Newest task of our own queue first, it is the most likely to be hot in cache
+	{
+		Queue& own = *queues[queueIndex];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = own.tasks.back();
+			own.tasks.pop_back();
+			--queuedTasks;
+			return true;
+		}
+	}
+
+	// Steal the oldest task of another queue
+	unsigned count = (unsigned)queues.size();
+	for (unsigned i = 1; i < count; ++i) {
+		Queue& victim = *queues[(queueIndex + i) % count];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = victim.tasks.front();
+			victim.tasks.pop_front();
+			--queuedTasks;
+			return true;
+		}
+	}
+	return false;
+}
+
+void JobSystem::runTask(const Task& task) {
+	(*task.job)(task.begin, task.end);
+	task.batch->remaining.fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::workerLoop(unsigned queueIndex) {
+	currentSystem = this;
+	currentQueue = queueIndex;
+
+	Task task;
+	for (;;) {
+		if (findTask(queueIndex, task)) {
+			runTask(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wakeUp.wait(lock, [this] { return stopping || queuedTasks > 0; });
+		if (stopping) {
+			return;
+		}
+	}
+}
+
+void JobSystem::parallelFor(unsigned count, unsigned grain, const RangeJob& job) {
+	if (count == 0) {
+		return;
+	}
+	if (grain == 0) {
+		grain = 1;
+	}
+
+	// Not worth waking the workers for a single range
+	if (count <= grain || workers.empty()) {
+		job(0, count);
+		return;
+	}
+
+	Batch batch;
+	unsigned tasks = (count + grain - 1) / grain;
+	batch.remaining = tasks;
+
+	// Spread the ranges over all the queues, the workers steal whatever is left unbalanced
+	unsigned queueCount = (unsigned)queues.size();
+	unsigned first = getQueueIndex();
+	for (unsigned t = 0; t < tasks; ++t) {
+		Task task;
+		task.job = &job;
+		task.begin = t * grain;
+		task.end = task.begin + grain < count ? task.begin + grain : count;
+		task.batch = &batch;
+
+		Queue& queue = *queues[(first + t) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(task);
+		++queuedTasks;
+	}
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	wakeUp.notify_all();
+
+	// Help until the whole batch is done
+	Task task;
+	while (batch.remaining.load(std::memory_order_acquire) > 0) {
+		if (findTask(first, task)) {
+			runTask(task);
+		}
+		else {
+			std::this_thread::yield();
+		}
+	}
+}
\ No newline at end of file
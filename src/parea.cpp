@@ -0,0 +1,206 @@
+#include <assert.h>
+#include "cyclone/parea.h"
+
+using namespace cyclone;
+
+namespace {
+	// Reached particles per task when the update is split over a job system
+	const unsigned AREA_GRAIN = 1024;
+
+	// Capacity of the first query, grown to the largest count seen
+	const unsigned INITIAL_REACH = 256;
+
+	// Offset of a particle from a point, computed in the precision of the positions
+	Vector3 getOffset(const ParticleStore* store, unsigned index, const Vector3& point) {
+		return Vector3((real)(store->positionX[index] - point.x), (real)(store->positionY[index] - point.y), (real)(store->positionZ[index] - point.z));
+	}
+
+	real maxReal(real a, real b) { return a > b ? a : b; }
+}
+
+void ParticleAreaForce::apply(ParticleStore* store, const ParticleQuery* query, real duration, JobSystem* jobs) {
+	ParticleSphere bounds;
+	if (!getBounds(bounds)) {
+		return;
+	}
+
+	// The buffer only grows, its size is the capacity of the query
+	unsigned count = 0;
+	if (query) {
+		if (reached.size() < INITIAL_REACH) {
+			reached.resize(INITIAL_REACH);
+		}
+
+		// The count tells when the buffer was too small, the query then runs again with enough room
+		count = query->querySphere(bounds, reached.data(), (unsigned)reached.size());
+		if (count > reached.size()) {
+			reached.resize(count);
+			query->querySphere(bounds, reached.data(), count);
+		}
+	}
+	else {
+		if (reached.size() < store->size()) {
+			reached.resize(store->size());
+		}
+		real radiusSquared = bounds.radius * bounds.radius;
+		for (unsigned i = 0; i < store->size(); ++i) {
+			if (getOffset(store, i, bounds.centre).squareMagnitude() <= radiusSquared) {
+				reached[count++] = i;
+			}
+		}
+	}
+
+	// Each particle is reached once, so the ranges update disjoint particles
+	const unsigned* indices = reached.data();
+	if (jobs && count > AREA_GRAIN) {
+		jobs->parallelFor(count, AREA_GRAIN, [this, store, indices, duration](unsigned begin, unsigned end) {
+			updateForces(store, indices + begin, end - begin, duration);
+		});
+	}
+	else {
+		updateForces(store, indices, count, duration);
+	}
+}
+
+ParticleExplosion::ParticleExplosion(const Vector3& detonation) :
+	detonation(detonation),
+	implosionMaxRadius(0), implosionMinRadius(0), implosionDuration(0), implosionForce(0),
+	shockwaveSpeed(0), shockwaveThickness(0), peakConcussionForce(0), concussionDuration(0),
+	peakConvectionForce(0), chimneyRadius(0), chimneyHeight(0), convectionDuration(0),
+	time(0)
+{
+}
+
+bool ParticleExplosion::isFinished() const {
+	real after = time - implosionDuration;
+	return after >= concussionDuration && after >= convectionDuration;
+}
+
+bool ParticleExplosion::getBounds(ParticleSphere& bounds) const {
+	real radius = 0;
+	if (time < implosionDuration) {
+		radius = implosionMaxRadius;
+	}
+	else {
+		real after = time - implosionDuration;
+		if (after < concussionDuration) {
+			radius = maxReal(radius, shockwaveSpeed * after + shockwaveThickness);
+		}
+		if (after < convectionDuration) {
+			radius = maxReal(radius, real_sqrt(chimneyRadius * chimneyRadius + chimneyHeight * chimneyHeight));
+		}
+	}
+
+	bounds.centre = detonation;
+	bounds.radius = radius;
+	return radius > 0;
+}
+
+void ParticleExplosion::updateForces(ParticleStore* store, const unsigned* indices, unsigned count, real duration) {
+	bool implosion = time < implosionDuration;
+	real after = time - implosionDuration;
+	bool concussion = !implosion && after < concussionDuration;
+	bool convection = !implosion && after < convectionDuration;
+
+	// Fading of the later phases and position of the shockwave, the same for all the particles
+	real concussionScale = concussion ? peakConcussionForce * (1 - after / concussionDuration) : 0;
+	real convectionScale = convection ? peakConvectionForce * (1 - after / convectionDuration) : 0;
+	real front = shockwaveSpeed * after;
+
+	for (unsigned n = 0; n < count; ++n) {
+		unsigned i = indices[n];
+		Vector3 offset = getOffset(store, i, detonation);
+		real distance = offset.magnitude();
+		Vector3 force;
+
+		if (implosion) {
+			if (distance >= implosionMinRadius && distance <= implosionMaxRadius && distance > 0) {
+				force = offset * (-implosionForce / distance);
+			}
+		}
+		else {
+			if (concussion && distance > 0) {
+				real fromFront = real_abs(distance - front);
+				if (fromFront < shockwaveThickness) {
+					force += offset * (concussionScale * (1 - fromFront / shockwaveThickness) / distance);
+				}
+			}
+			if (convection && offset.y >= 0 && offset.y <= chimneyHeight) {
+				real fromAxis = real_sqrt(offset.x * offset.x + offset.z * offset.z);
+				if (fromAxis < chimneyRadius) {
+					force.y += convectionScale * (1 - fromAxis / chimneyRadius);
+				}
+			}
+		}
+
+		if (force.x != 0 || force.y != 0 || force.z != 0) {
+			store->setAwake(i);
+			store->addForce(i, force);
+		}
+	}
+}
+
+ParticleWind::ParticleWind(const Vector3& centre, real radius, const Vector3& velocity, real dragCoefficient) :
+	centre(centre), radius(radius), velocity(velocity), dragCoefficient(dragCoefficient)
+{
+}
+
+bool ParticleWind::getBounds(ParticleSphere& bounds) const {
+	bounds.centre = centre;
+	bounds.radius = radius;
+	return radius > 0 && dragCoefficient != 0;
+}
+
+void ParticleWind::updateForces(ParticleStore* store, const unsigned* indices, unsigned count, real duration) {
+	real radiusSquared = radius * radius;
+	for (unsigned n = 0; n < count; ++n) {
+		unsigned i = indices[n];
+		if (getOffset(store, i, centre).squareMagnitude() > radiusSquared) {
+			continue;
+		}
+
+		Vector3 relative(velocity.x - store->velocityX[i], velocity.y - store->velocityY[i], velocity.z - store->velocityZ[i]);
+		if (relative.x != 0 || relative.y != 0 || relative.z != 0) {
+			store->setAwake(i);
+			store->addForce(i, relative * dragCoefficient);
+		}
+	}
+}
+
+ParticleVortex::ParticleVortex(const Vector3& centre, const Vector3& axis, real radius, real tangentialForce, real inwardForce, real liftForce) :
+	centre(centre), axis(axis), radius(radius), tangentialForce(tangentialForce), inwardForce(inwardForce), liftForce(liftForce)
+{
+}
+
+bool ParticleVortex::getBounds(ParticleSphere& bounds) const {
+	bounds.centre = centre;
+	bounds.radius = radius;
+	return radius > 0;
+}
+
+void ParticleVortex::updateForces(ParticleStore* store, const unsigned* indices, unsigned count, real duration) {
+	for (unsigned n = 0; n < count; ++n) {
+		unsigned i = indices[n];
+		Vector3 offset = getOffset(store, i, centre);
+		real distance = offset.magnitude();
+		if (distance >= radius) {
+			continue;
+		}
+
+		// Split the offset along the axis and across it
+		Vector3 radial = offset - axis * (offset * axis);
+		real fromAxis = radial.magnitude();
+		Vector3 force = axis * liftForce;
+		if (fromAxis > 0) {
+			radial *= 1 / fromAxis;
+			force += axis.VectorProduct(radial) * tangentialForce;
+			force -= radial * inwardForce;
+		}
+		force *= 1 - distance / radius;
+
+		if (force.x != 0 || force.y != 0 || force.z != 0) {
+			store->setAwake(i);
+			store->addForce(i, force);
+		}
+	}
+}
\ No newline at end of file
@@ -1,15 +1,25 @@
 #include <assert.h>
 #include <cyclone/particle.h>
 #include "cyclone/precision.h"
+#include "cyclone/pstore.h"
 
 using namespace cyclone;
 
+Particle::Particle() : inverseMass(1), damping(1), dampingFactor(1), sleepBias(1), dampingDuration(0), motion(sleepEpsilon * 2), isAwake(true), canSleep(false), store(0), index(0) {
+}
+
 void Particle::setMass(const real mass) {
 	assert(mass != 0);
-	Particle::inverseMass = ((real)1.0) / mass;
+	setInverseMass(((real)1.0) / mass);
 }
 
 real Particle::getMass() const {
+	// Particles of a store have their mass cached, saving the division
+	if (store && store->inverseMass[index] != 0) {
+		return store->mass[index];
+	}
+
+	real inverseMass = getInverseMass();
 	if (inverseMass == 0) {
 		return REAL_MAX;
 	}
@@ -19,16 +29,57 @@ real Particle::getMass() const {
 }
 
 void Particle::setInverseMass(const real inverseMass) {
+	if (store) {
+		store->setInverseMass(index, inverseMass);
+		return;
+	}
 	Particle::inverseMass = inverseMass;
 }
 
 real Particle::getInverseMass() const {
+	if (store) {
+		return store->inverseMass[index];
+	}
 	return inverseMass;
 }
 
+void Particle::setDamping(const real damping) {
+	if (store) {
+		store->damping[index] = damping;
+		return;
+	}
+	Particle::damping = damping;
+	dampingDuration = 0;
+}
+
+real Particle::getDamping() const {
+	if (store) {
+		return store->damping[index];
+	}
+	return damping;
+}
+
 void Particle::integrate(real duration) {
+	if (store) {
+		// The handle caches the factors of its particle, keyed by the damping in the store
+		real storeDamping = store->damping[index];
+		if (duration != dampingDuration || storeDamping != damping) {
+			damping = storeDamping;
+			dampingFactor = real_pow(damping, duration);
+			sleepBias = real_pow(((real)0.5), duration);
+			dampingDuration = duration;
+		}
+		store->integrate(index, duration, dampingFactor, sleepBias);
+		return;
+	}
+
 	assert(duration > 0.0);
 
+	// Sleeping particles do not move
+	if (!isAwake) {
+		return;
+	}
+
 	// Update linear position
 	position.AddScaledVector(velocity, duration);
 
@@ -39,37 +90,166 @@ void Particle::integrate(real duration) {
 	// Update velocity from linear acceleration
 	velocity.AddScaledVector(resultingAcceleration, duration);
 
-	// Drag
-	velocity *= real_pow(damping, duration);
+	// Drag, the factors only change with the damping or the duration, usually fixed
+	if (duration != dampingDuration) {
+		dampingFactor = real_pow(damping, duration);
+		sleepBias = real_pow(((real)0.5), duration);
+		dampingDuration = duration;
+	}
+	velocity *= dampingFactor;
 
 	// Clear the forces
 	clearAccumulator();
+
+	// Update the kinetic energy average and put the particle to sleep if it is at rest
+	if (canSleep) {
+		real currentMotion = velocity.squareMagnitude();
+		motion = sleepBias * motion + (1 - sleepBias) * currentMotion;
+
+		if (motion < sleepEpsilon) {
+			setAwake(false);
+		}
+		else if (motion > 10 * sleepEpsilon) {
+			motion = 10 * sleepEpsilon;
+		}
+	}
 }
 
 void Particle::clearAccumulator() {
+	if (store) {
+		store->clearAccumulator(index);
+		return;
+	}
 	forceAccum.clear();
 }
 
 void Particle::addForce(const Vector3& force) {
+	if (store) {
+		store->addForce(index, force);
+		store->setAwake(index);
+		return;
+	}
 	forceAccum += force;
+	if (!isAwake) {
+		setAwake();
+	}
 }
 
 bool Particle::hasFiniteMass() const {
-	return inverseMass >= 0.0f;
+	return getInverseMass() >= 0.0f;
+}
+
+void Particle::setPosition(const Vector3& position) {
+	if (store) {
+		store->setPosition(index, position);
+		return;
+	}
+	Particle::position = position;
 }
 
 void Particle::getPosition(Vector3* position) const {
-	*position = Particle::position;
+	*position = getPosition();
 }
 
 Vector3 Particle::getPosition() const {
+	if (store) {
+		return store->getPosition(index);
+	}
 	return position;
 }
 
+void Particle::translate(const Vector3& offset) {
+	if (store) {
+		store->translate(index, offset);
+		return;
+	}
+	position += offset;
+}
+
+Vector3 Particle::getSeparation(const Particle& other) const {
+	if (store && store == other.store) {
+		return store->getSeparation(index, other.index);
+	}
+	return getPosition() - other.getPosition();
+}
+
+void Particle::setVelocity(const Vector3& velocity) {
+	if (store) {
+		store->setVelocity(index, velocity);
+		return;
+	}
+	Particle::velocity = velocity;
+}
+
 void Particle::getVelocity(Vector3* velocity) const{
-	*velocity = Particle::velocity;
+	*velocity = getVelocity();
 }
 
 Vector3 Particle::getVelocity() const {
+	if (store) {
+		return store->getVelocity(index);
+	}
 	return velocity;
+}
+
+void Particle::setAcceleration(const Vector3& acceleration) {
+	if (store) {
+		store->setAcceleration(index, acceleration);
+		return;
+	}
+	Particle::acceleration = acceleration;
+}
+
+Vector3 Particle::getAcceleration() const {
+	if (store) {
+		return store->getAcceleration(index);
+	}
+	return acceleration;
+}
+
+bool Particle::getAwake() const {
+	if (store) {
+		return store->awake[index] != 0;
+	}
+	return isAwake;
+}
+
+void Particle::setAwake(const bool awake) {
+	if (store) {
+		store->setAwake(index, awake);
+		return;
+	}
+
+	if (awake) {
+		isAwake = true;
+
+		// Add a bit of motion to avoid it falling asleep immediately
+		motion = sleepEpsilon * 2.0f;
+	}
+	else {
+		isAwake = false;
+		velocity.clear();
+	}
+}
+
+bool Particle::getCanSleep() const {
+	if (store) {
+		return store->canSleep[index] != 0;
+	}
+	return canSleep;
+}
+
+void Particle::setCanSleep(const bool canSleep) {
+	if (store) {
+		store->canSleep[index] = canSleep;
+		if (!canSleep) {
+			store->setAwake(index);
+		}
+		return;
+	}
+
+	Particle::canSleep = canSleep;
+	if (!canSleep && !isAwake) {
+		setAwake();
+	}
 }
\ No newline at end of file
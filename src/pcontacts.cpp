@@ -0,0 +1,337 @@
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "cyclone/pcontacts.h"
+
+using namespace cyclone;
+
+void ParticleContact::resolve(real duration) {
+	resolveVelocity(duration);
+	resolveInterpenetration(duration);
+}
+
+real ParticleContact::calculateSeparatingVelocity() const {
+	Vector3 relativeVelocity = particle[0]->getVelocity();
+	if (particle[1]) {
+		relativeVelocity -= particle[1]->getVelocity();
+	}
+	return relativeVelocity * contactNormal;
+}
+
+void ParticleContact::resolveVelocity(real duration) {
+	// Velocity in the direction of the contact
+	real separatingVelocity = calculateSeparatingVelocity();
+
+	// Separating or stationary: no impulse required
+	if (separatingVelocity > 0) {
+		return;
+	}
+
+	real newSepVelocity = -separatingVelocity * restitution;
+
+	// Velocity build-up due to acceleration only, removed so resting contacts do not jitter
+	Vector3 accCausedVelocity = particle[0]->getAcceleration();
+	if (particle[1]) {
+		accCausedVelocity -= particle[1]->getAcceleration();
+	}
+	real accCausedSepVelocity = accCausedVelocity * contactNormal * duration;
+
+	if (accCausedSepVelocity < 0) {
+		newSepVelocity += restitution * accCausedSepVelocity;
+		if (newSepVelocity < 0) {
+			newSepVelocity = 0;
+		}
+	}
+
+	real deltaVelocity = newSepVelocity - separatingVelocity;
+
+	// Velocity change applied in proportion to the inverse mass
+	real totalInverseMass = particle[0]->getInverseMass();
+	if (particle[1]) {
+		totalInverseMass += particle[1]->getInverseMass();
+	}
+
+	// Both particles with infinite mass: impulses have no effect
+	if (totalInverseMass <= 0) {
+		return;
+	}
+
+	real impulse = deltaVelocity / totalInverseMass;
+	Vector3 impulsePerIMass = contactNormal * impulse;
+
+	particle[0]->setVelocity(particle[0]->getVelocity() + impulsePerIMass * particle[0]->getInverseMass());
+	if (particle[1]) {
+		// The second particle goes in the opposite direction
+		particle[1]->setVelocity(particle[1]->getVelocity() + impulsePerIMass * -particle[1]->getInverseMass());
+	}
+}
+
+void ParticleContact::resolveInterpenetration(real duration) {
+	particleMovement[0].clear();
+	particleMovement[1].clear();
+
+	// No penetration: nothing to do
+	if (penetration <= 0) {
+		return;
+	}
+
+	// Movement of each particle is proportional to the inverse mass
+	real totalInverseMass = particle[0]->getInverseMass();
+	if (particle[1]) {
+		totalInverseMass += particle[1]->getInverseMass();
+	}
+
+	if (totalInverseMass <= 0) {
+		return;
+	}
+
+	Vector3 movePerIMass = contactNormal * (penetration / totalInverseMass);
+
+	particleMovement[0] = movePerIMass * particle[0]->getInverseMass();
+	particle[0]->translate(particleMovement[0]);
+	if (particle[1]) {
+		particleMovement[1] = movePerIMass * -particle[1]->getInverseMass();
+		particle[1]->translate(particleMovement[1]);
+	}
+}
+
+namespace {
+	// Binary heap of contact indices giving the contact with the highest priority, where the
+	// priority of each contact can be changed in place. Ties go to the lowest index so the
+	// resolution order does not depend on anything but the contact list
+	class ContactHeap {
+		std::vector<unsigned> heap; // Contact indices
+		std::vector<unsigned> slot; // Position of each contact in the heap
+		std::vector<real> priority;
+
+		bool higher(unsigned a, unsigned b) const {
+			if (priority[a] != priority[b]) {
+				return priority[a] > priority[b];
+			}
+			return a < b;
+		}
+
+		void place(unsigned position, unsigned contact) {
+			heap[position] = contact;
+			slot[contact] = position;
+		}
+
+		void siftUp(unsigned position) {
+			unsigned contact = heap[position];
+			while (position > 0) {
+				unsigned parent = (position - 1) / 2;
+				if (!higher(contact, heap[parent])) {
+					break;
+				}
+				place(position, heap[parent]);
+				position = parent;
+			}
+			place(position, contact);
+		}
+
+		void siftDown(unsigned position) {
+			unsigned contact = heap[position];
+			unsigned count = (unsigned)heap.size();
+			for (;;) {
+				unsigned child = position * 2 + 1;
+				if (child >= count) {
+					break;
+				}
+				if (child + 1 < count && higher(heap[child + 1], heap[child])) {
+					++child;
+				}
+				if (!higher(heap[child], contact)) {
+					break;
+				}
+				place(position, heap[child]);
+				position = child;
+			}
+			place(position, contact);
+		}
+
+	public:
+		void build(unsigned count) {
+			heap.resize(count);
+			slot.resize(count);
+			priority.resize(count);
+			for (unsigned i = 0; i < count; ++i) {
+				heap[i] = i;
+				slot[i] = i;
+			}
+		}
+
+		void setInitial(unsigned contact, real value) {
+			priority[contact] = value;
+		}
+
+		// Restore the heap property after all the initial priorities have been set
+		void heapify() {
+			for (unsigned i = (unsigned)heap.size() / 2; i-- > 0;) {
+				siftDown(i);
+			}
+		}
+
+		unsigned top() const { return heap[0]; }
+		real topPriority() const { return priority[heap[0]]; }
+
+		real get(unsigned contact) const { return priority[contact]; }
+
+		void update(unsigned contact, real value) {
+			real old = priority[contact];
+			priority[contact] = value;
+			if (value > old) {
+				siftUp(slot[contact]);
+			}
+			else if (value < old) {
+				siftDown(slot[contact]);
+			}
+		}
+	};
+
+	// For each particle, the list of contacts touching it
+	class ContactAdjacency {
+		std::vector<std::pair<Particle*, unsigned> > entries; // Sorted by particle
+		std::vector<unsigned> range[2]; // For each contact and end, first entry of the particle
+
+	public:
+		void build(const ParticleContact* contacts, unsigned count) {
+			entries.clear();
+			for (unsigned i = 0; i < count; ++i) {
+				entries.push_back(std::make_pair(contacts[i].particle[0], i));
+				if (contacts[i].particle[1]) {
+					entries.push_back(std::make_pair(contacts[i].particle[1], i));
+				}
+			}
+			std::sort(entries.begin(), entries.end());
+
+			range[0].assign(count, 0);
+			range[1].assign(count, (unsigned)entries.size());
+			for (unsigned e = 0; e < entries.size(); ++e) {
+				if (e > 0 && entries[e].first == entries[e - 1].first) {
+					continue;
+				}
+				// e is the first entry of a particle, point the contacts of the particle to it
+				for (unsigned k = e; k < entries.size() && entries[k].first == entries[e].first; ++k) {
+					const ParticleContact& contact = contacts[entries[k].second];
+					range[contact.particle[0] == entries[e].first ? 0 : 1][entries[k].second] = e;
+				}
+			}
+		}
+
+		// Iterate the contacts touching the given end of a contact
+		unsigned begin(unsigned contact, unsigned end) const { return range[end][contact]; }
+
+		bool valid(unsigned entry, Particle* particle) const {
+			return entry < entries.size() && entries[entry].first == particle;
+		}
+
+		unsigned contactAt(unsigned entry) const { return entries[entry].second; }
+	};
+}
+
+ParticleContactResolver::ParticleContactResolver(unsigned iterations) :
+	velocityIterations(iterations), positionIterations(iterations), iterationsUsed(0)
+{
+}
+
+void ParticleContactResolver::setIterations(unsigned iterations) {
+	setIterations(iterations, iterations);
+}
+
+void ParticleContactResolver::setIterations(unsigned velocityIterations, unsigned positionIterations) {
+	ParticleContactResolver::velocityIterations = velocityIterations;
+	ParticleContactResolver::positionIterations = positionIterations;
+}
+
+void ParticleContactResolver::resolveContacts(ParticleContact* contactArray, unsigned numContacts, real duration) {
+	iterationsUsed = 0;
+	if (numContacts == 0) {
+		return;
+	}
+
+	// A moving particle touching a sleeping one wakes it up
+	for (unsigned i = 0; i < numContacts; ++i) {
+		ParticleContact& contact = contactArray[i];
+		if (!contact.particle[1]) {
+			continue;
+		}
+		bool awake0 = contact.particle[0]->getAwake();
+		bool awake1 = contact.particle[1]->getAwake();
+		if (awake0 != awake1) {
+			contact.particle[awake0 ? 1 : 0]->setAwake();
+		}
+	}
+
+	ContactAdjacency adjacency;
+	adjacency.build(contactArray, numContacts);
+
+	ContactHeap heap;
+
+	// Velocity phase: the priority is the closing velocity (the opposite of the separating one)
+	heap.build(numContacts);
+	for (unsigned i = 0; i < numContacts; ++i) {
+		heap.setInitial(i, -contactArray[i].calculateSeparatingVelocity());
+	}
+	heap.heapify();
+
+	for (unsigned iteration = 0; iteration < velocityIterations; ++iteration) {
+		if (heap.topPriority() <= 0) {
+			break;
+		}
+
+		unsigned worst = heap.top();
+		ParticleContact& contact = contactArray[worst];
+		contact.resolveVelocity(duration);
+		++iterationsUsed;
+
+		// Only the contacts sharing a particle can have changed
+		for (unsigned end = 0; end < 2; ++end) {
+			Particle* particle = contact.particle[end];
+			if (!particle) {
+				continue;
+			}
+			for (unsigned e = adjacency.begin(worst, end); adjacency.valid(e, particle); ++e) {
+				unsigned other = adjacency.contactAt(e);
+				heap.update(other, -contactArray[other].calculateSeparatingVelocity());
+			}
+		}
+	}
+
+	// Interpenetration phase: the priority is the penetration depth
+	heap.build(numContacts);
+	for (unsigned i = 0; i < numContacts; ++i) {
+		heap.setInitial(i, contactArray[i].penetration);
+	}
+	heap.heapify();
+
+	for (unsigned iteration = 0; iteration < positionIterations; ++iteration) {
+		if (heap.topPriority() <= 0) {
+			break;
+		}
+
+		unsigned worst = heap.top();
+		ParticleContact& contact = contactArray[worst];
+		contact.resolveInterpenetration(duration);
+		++iterationsUsed;
+
+		// Update the penetrations of the contacts sharing a particle with the movement applied
+		for (unsigned end = 0; end < 2; ++end) {
+			Particle* particle = contact.particle[end];
+			if (!particle) {
+				continue;
+			}
+			const Vector3& move = contact.particleMovement[end];
+			for (unsigned e = adjacency.begin(worst, end); adjacency.valid(e, particle); ++e) {
+				unsigned other = adjacency.contactAt(e);
+				ParticleContact& touched = contactArray[other];
+				if (touched.particle[0] == particle) {
+					touched.penetration -= move * touched.contactNormal;
+				}
+				else {
+					touched.penetration += move * touched.contactNormal;
+				}
+				heap.update(other, touched.penetration);
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -1,27 +1,376 @@
+#include <cstring>
+#include <typeinfo>
 #include "cyclone/pfgen.h"
+#include "cyclone/jobs.h"
+#include "cyclone/profile.h"
+#include "cyclone/pstore.h"
 
 using namespace cyclone;
 
+namespace {
+	// Marks the end of the slot lists
+	const unsigned NO_SLOT = 0xffffffff;
+}
+
+void ParticleForceGenerator::updateForces(Particle* const* particles, size_t count, real duration) {
+	for (size_t i = 0; i < count; ++i) {
+		updateForce(particles[i], duration);
+	}
+}
+
+void ParticleForceGenerator::updateForces(ParticleStore* store, unsigned begin, unsigned end, real duration) {
+	for (unsigned i = begin; i < end; ++i) {
+		if (store->isAwake(i)) {
+			updateForce(store->getParticle(i), duration);
+		}
+	}
+}
+
+ParticleForceRegistry::ParticleForceRegistry(bool bucketed) :
+	bucketed(bucketed), firstFreeSlot(NO_SLOT), particleChains(0, std::hash<Particle*>(), std::equal_to<Particle*>(), &chainNodes), parallelDirty(true)
+{
+}
+
+ParticleForceRegistry::Bucket ParticleForceRegistry::getBucket(ParticleForceGenerator* fg) const {
+	if (!bucketed) {
+		return BUCKET_GENERIC;
+	}
+
+	// Exact type match: a user type deriving from a built-in generator keeps the virtual call
+	const std::type_info& type = typeid(*fg);
+	if (type == typeid(ParticleGravity)) return BUCKET_GRAVITY;
+	if (type == typeid(ParticleDrag)) return BUCKET_DRAG;
+	if (type == typeid(ParticleSpring)) return BUCKET_SPRING;
+	if (type == typeid(ParticleAnchoredSpring)) return BUCKET_ANCHORED_SPRING;
+	if (type == typeid(ParticleBungee)) return BUCKET_BUNGEE;
+	if (type == typeid(ParticleBuoyancy)) return BUCKET_BUOYANCY;
+	return BUCKET_GENERIC;
+}
+
+template<class Generator>
+void ParticleForceRegistry::updateBucket(unsigned b, real duration) {
+	Registry& bucket = registrations[b];
+	CYCLONE_PROFILE_GENERATOR_SCOPE(b, bucket.size());
+
+	// The qualified call skips the virtual dispatch and lets the compiler inline updateForce
+	Registry::iterator i = bucket.begin();
+	for (; i != bucket.end(); ++i) {
+		if (i->particle->getAwake()) {
+			static_cast<Generator*>(i->fg)->Generator::updateForce(i->particle, duration);
+		}
+	}
+}
+
+void ParticleForceRegistry::setBucketed(bool bucketed) {
+	if (ParticleForceRegistry::bucketed == bucketed) {
+		return;
+	}
+	ParticleForceRegistry::bucketed = bucketed;
+	parallelDirty = true;
+
+	// Redistribute the existing registrations
+	Registry all;
+	for (unsigned b = 0; b < BUCKET_COUNT; ++b) {
+		all.insert(all.end(), registrations[b].begin(), registrations[b].end());
+		registrations[b].clear();
+	}
+	for (Registry::iterator i = all.begin(); i != all.end(); ++i) {
+		unsigned bucket = getBucket(i->fg);
+		slots[i->slot].bucket = bucket;
+		slots[i->slot].position = (unsigned)registrations[bucket].size();
+		registrations[bucket].push_back(*i);
+	}
+}
+
 void ParticleForceRegistry::updateForces(real duration) {
-	Registry::iterator i = registrations.begin();
-	for (; i != registrations.end(); ++i) {
-		i->fg->updateForce(i->particle, duration);
+	static_assert((int)BUCKET_COUNT == (int)PROFILE_GENERATOR_COUNT, "The profiler has a generator type per bucket");
+	CYCLONE_PROFILE_SCOPE(PROFILE_FORCES);
+
+	updateBucket<ParticleGravity>(BUCKET_GRAVITY, duration);
+	updateBucket<ParticleDrag>(BUCKET_DRAG, duration);
+	updateBucket<ParticleSpring>(BUCKET_SPRING, duration);
+	updateBucket<ParticleAnchoredSpring>(BUCKET_ANCHORED_SPRING, duration);
+	updateBucket<ParticleBungee>(BUCKET_BUNGEE, duration);
+	updateBucket<ParticleBuoyancy>(BUCKET_BUOYANCY, duration);
+
+	// Consecutive registrations of a generator, typically one shared by many particles, are applied
+	// by a single batch call
+	Registry& generic = registrations[BUCKET_GENERIC];
+	CYCLONE_PROFILE_GENERATOR_SCOPE(BUCKET_GENERIC, generic.size());
+	Registry::iterator i = generic.begin();
+	while (i != generic.end()) {
+		ParticleForceGenerator* fg = i->fg;
+		batch.clear();
+		for (; i != generic.end() && i->fg == fg; ++i) {
+			if (i->particle->getAwake()) {
+				batch.push_back(i->particle);
+			}
+		}
+		if (!batch.empty()) {
+			fg->updateForces(batch.data(), batch.size(), duration);
+		}
+	}
+}
+
+void ParticleForceRegistry::applyRegistration(unsigned bucket, ParticleForceRegistration& registration, real duration) {
+	if (!registration.particle->getAwake()) {
+		return;
+	}
+
+	switch (bucket) {
+	case BUCKET_GRAVITY:
+		static_cast<ParticleGravity*>(registration.fg)->ParticleGravity::updateForce(registration.particle, duration);
+		break;
+	case BUCKET_DRAG:
+		static_cast<ParticleDrag*>(registration.fg)->ParticleDrag::updateForce(registration.particle, duration);
+		break;
+	case BUCKET_SPRING:
+		static_cast<ParticleSpring*>(registration.fg)->ParticleSpring::updateForce(registration.particle, duration);
+		break;
+	case BUCKET_ANCHORED_SPRING:
+		static_cast<ParticleAnchoredSpring*>(registration.fg)->ParticleAnchoredSpring::updateForce(registration.particle, duration);
+		break;
+	case BUCKET_BUNGEE:
+		static_cast<ParticleBungee*>(registration.fg)->ParticleBungee::updateForce(registration.particle, duration);
+		break;
+	case BUCKET_BUOYANCY:
+		static_cast<ParticleBuoyancy*>(registration.fg)->ParticleBuoyancy::updateForce(registration.particle, duration);
+		break;
+	default:
+		registration.fg->updateForce(registration.particle, duration);
+		break;
+	}
+}
+
+void ParticleForceRegistry::buildParallelGroups() {
+	// Assign each particle a group, in order of first appearance in the serial order
+	std::unordered_map<Particle*, unsigned> groupOf;
+	std::vector<unsigned> entryGroup;
+	std::vector<ParallelEntry> serial;
+	std::vector<unsigned> groupSize;
+	for (unsigned b = 0; b < BUCKET_COUNT; ++b) {
+		for (unsigned i = 0; i < registrations[b].size(); ++i) {
+			std::pair<std::unordered_map<Particle*, unsigned>::iterator, bool> group =
+				groupOf.insert(std::make_pair(registrations[b][i].particle, (unsigned)groupSize.size()));
+			if (group.second) {
+				groupSize.push_back(0);
+			}
+			++groupSize[group.first->second];
+
+			ParallelEntry entry = { b, i };
+			serial.push_back(entry);
+			entryGroup.push_back(group.first->second);
+		}
+	}
+
+	// Counting sort by group, stable so each group keeps the serial order
+	unsigned groups = (unsigned)groupSize.size();
+	parallelGroups.resize(groups + 1);
+	unsigned start = 0;
+	for (unsigned g = 0; g < groups; ++g) {
+		parallelGroups[g] = start;
+		start += groupSize[g];
+	}
+	parallelGroups[groups] = start;
+
+	parallelEntries.resize(serial.size());
+	std::vector<unsigned> cursor(parallelGroups.begin(), parallelGroups.end() - 1);
+	for (unsigned i = 0; i < serial.size(); ++i) {
+		parallelEntries[cursor[entryGroup[i]]++] = serial[i];
+	}
+
+	parallelDirty = false;
+}
+
+void ParticleForceRegistry::updateForces(real duration, JobSystem& jobs) {
+	CYCLONE_PROFILE_SCOPE(PROFILE_FORCES);
+
+	if (parallelDirty) {
+		buildParallelGroups();
+	}
+
+	unsigned groups = (unsigned)parallelGroups.size() - 1;
+	jobs.parallelFor(groups, 256, [this, duration](unsigned begin, unsigned end) {
+		for (unsigned e = parallelGroups[begin]; e < parallelGroups[end]; ++e) {
+			const ParallelEntry& entry = parallelEntries[e];
+			applyRegistration(entry.bucket, registrations[entry.bucket][entry.position], duration);
+		}
+	});
+
+#if defined(CYCLONE_PROFILING)
+	// Timing each generator type would need a clock read per registration, only count them
+	for (unsigned b = 0; b < BUCKET_COUNT; ++b) {
+		CYCLONE_PROFILE_GENERATOR_CALLS(b, registrations[b].size());
 	}
+#endif
 }
 
-void ParticleForceRegistry::add(Particle* particle, ParticleForceGenerator *fg) {
+ParticleForceRegistry::Handle ParticleForceRegistry::add(Particle* particle, ParticleForceGenerator *fg) {
+	// Take a free slot or grow the index
+	unsigned slot = firstFreeSlot;
+	if (slot != NO_SLOT) {
+		firstFreeSlot = slots[slot].position;
+	}
+	else {
+		slot = (unsigned)slots.size();
+		Slot empty = { 0, 0, 0, NO_SLOT, NO_SLOT };
+		slots.push_back(empty);
+	}
+
+	unsigned bucket = getBucket(fg);
+	Slot& entry = slots[slot];
+	entry.bucket = bucket;
+	entry.position = (unsigned)registrations[bucket].size();
+
+	// Link at the head of the chain of the particle
+	std::pair<ParticleChains::iterator, bool> chain = particleChains.insert(std::make_pair(particle, slot));
+	entry.prevForParticle = NO_SLOT;
+	entry.nextForParticle = NO_SLOT;
+	if (!chain.second) {
+		entry.nextForParticle = chain.first->second;
+		slots[chain.first->second].prevForParticle = slot;
+		chain.first->second = slot;
+	}
+
 	ParticleForceRegistry::ParticleForceRegistration registration;
 	registration.particle = particle;
 	registration.fg = fg;
-	registrations.push_back(registration);
+	registration.slot = slot;
+	registrations[bucket].push_back(registration);
+	parallelDirty = true;
+
+	Handle handle = { slot, entry.generation };
+	return handle;
+}
+
+void ParticleForceRegistry::removeSlot(unsigned slot) {
+	Slot& entry = slots[slot];
+	Registry& bucket = registrations[entry.bucket];
+	Particle* particle = bucket[entry.position].particle;
+	parallelDirty = true;
+
+	// Swap and pop
+	if (entry.position + 1 != bucket.size()) {
+		bucket[entry.position] = bucket.back();
+		slots[bucket[entry.position].slot].position = entry.position;
+	}
+	bucket.pop_back();
+
+	// Unlink from the chain of the particle
+	if (entry.nextForParticle != NO_SLOT) {
+		slots[entry.nextForParticle].prevForParticle = entry.prevForParticle;
+	}
+	if (entry.prevForParticle != NO_SLOT) {
+		slots[entry.prevForParticle].nextForParticle = entry.nextForParticle;
+	}
+	else if (entry.nextForParticle != NO_SLOT) {
+		particleChains[particle] = entry.nextForParticle;
+	}
+	else {
+		particleChains.erase(particle);
+	}
+
+	// Invalidate the handles and release the slot
+	++entry.generation;
+	entry.position = firstFreeSlot;
+	firstFreeSlot = slot;
+}
+
+void ParticleForceRegistry::remove(Handle handle) {
+	if (!isValid(handle)) {
+		return;
+	}
+	removeSlot(handle.slot);
+}
+
+void ParticleForceRegistry::remove(Particle* particle, ParticleForceGenerator* fg) {
+	ParticleChains::iterator chain = particleChains.find(particle);
+	if (chain == particleChains.end()) {
+		return;
+	}
+
+	for (unsigned slot = chain->second; slot != NO_SLOT; slot = slots[slot].nextForParticle) {
+		if (registrations[slots[slot].bucket][slots[slot].position].fg == fg) {
+			removeSlot(slot);
+			return;
+		}
+	}
+}
+
+void ParticleForceRegistry::removeAllFor(Particle* particle) {
+	ParticleChains::iterator chain = particleChains.find(particle);
+	if (chain == particleChains.end()) {
+		return;
+	}
+
+	unsigned slot = chain->second;
+	particleChains.erase(chain);
+	parallelDirty = true;
+
+	while (slot != NO_SLOT) {
+		Slot& entry = slots[slot];
+		unsigned next = entry.nextForParticle;
+
+		// Swap and pop, the chain is dropped as a whole so there is nothing to unlink
+		Registry& bucket = registrations[entry.bucket];
+		if (entry.position + 1 != bucket.size()) {
+			bucket[entry.position] = bucket.back();
+			slots[bucket[entry.position].slot].position = entry.position;
+		}
+		bucket.pop_back();
+
+		++entry.generation;
+		entry.position = firstFreeSlot;
+		firstFreeSlot = slot;
+
+		slot = next;
+	}
+}
+
+bool ParticleForceRegistry::isValid(Handle handle) const {
+	// Removing a registration bumps the generation of its slot, so old handles no longer match
+	return handle.slot < slots.size() && slots[handle.slot].generation == handle.generation;
+}
+
+unsigned ParticleForceRegistry::size() const {
+	unsigned count = 0;
+	for (unsigned b = 0; b < BUCKET_COUNT; ++b) {
+		count += (unsigned)registrations[b].size();
+	}
+	return count;
+}
+
+void ParticleForceRegistry::getRegistrations(std::vector<Particle*>& particles, std::vector<ParticleForceGenerator*>& generators) const {
+	for (unsigned b = 0; b < BUCKET_COUNT; ++b) {
+		for (Registry::const_iterator i = registrations[b].begin(); i != registrations[b].end(); ++i) {
+			particles.push_back(i->particle);
+			generators.push_back(i->fg);
+		}
+	}
+}
+
+void ParticleForceRegistry::clear() {
+	for (unsigned b = 0; b < BUCKET_COUNT; ++b) {
+		Registry& bucket = registrations[b];
+		for (Registry::iterator i = bucket.begin(); i != bucket.end(); ++i) {
+			Slot& entry = slots[i->slot];
+			++entry.generation;
+			entry.position = firstFreeSlot;
+			firstFreeSlot = i->slot;
+		}
+		bucket.clear();
+	}
+	particleChains.clear();
+	parallelDirty = true;
 }
 
 ParticleGravity::ParticleGravity(const Vector3& gravity) : gravity(gravity) {
 }
 
 void ParticleGravity::updateForce(Particle* particle, real duration) {
-	// Check: infinite mass?
-	if (!particle->hasFiniteMass()) {
+	// Check: infinite mass? hasFiniteMass accepts a zero inverse mass, which would scale
+	// gravity by REAL_MAX, so test it the way the store path does
+	if (particle->getInverseMass() == 0) {
 		return;
 	}
 
@@ -29,6 +378,26 @@ void ParticleGravity::updateForce(Particle* particle, real duration) {
 	particle->addForce(gravity * particle->getMass());
 }
 
+void ParticleGravity::updateForces(Particle* const* particles, size_t count, real duration) {
+	for (size_t i = 0; i < count; ++i) {
+		ParticleGravity::updateForce(particles[i], duration);
+	}
+}
+
+void ParticleGravity::updateForces(ParticleStore* store, unsigned begin, unsigned end, real duration) {
+	real* fx = store->forceX.data(); real* fy = store->forceY.data(); real* fz = store->forceZ.data();
+	const real* mass = store->mass.data();
+	const unsigned char* awake = store->awake.data();
+
+	for (unsigned i = begin; i < end; ++i) {
+		// Infinite masses have a zero cached mass, sleeping particles get no force
+		real scale = awake[i] ? mass[i] : 0;
+		fx[i] += gravity.x * scale;
+		fy[i] += gravity.y * scale;
+		fz[i] += gravity.z * scale;
+	}
+}
+
 ParticleDrag::ParticleDrag(real k1, real k2) : k1(k1), k2(k2) {
 }
 
@@ -46,15 +415,57 @@ void ParticleDrag::updateForce(Particle* particle, real duration) {
 	particle->addForce(force);
 }
 
+void ParticleDrag::updateForces(Particle* const* particles, size_t count, real duration) {
+	for (size_t i = 0; i < count; ++i) {
+		ParticleDrag::updateForce(particles[i], duration);
+	}
+}
+
+void ParticleDrag::updateForces(ParticleStore* store, unsigned begin, unsigned end, real duration) {
+	const real* vx = store->velocityX.data(); const real* vy = store->velocityY.data(); const real* vz = store->velocityZ.data();
+	real* fx = store->forceX.data(); real* fy = store->forceY.data(); real* fz = store->forceZ.data();
+	const unsigned char* awake = store->awake.data();
+
+	unsigned i = begin;
+#if defined(CYCLONE_SIMD_SSE)
+	// Four particles at a time, same operations as the scalar loop
+	__m128 k1s = _mm_set1_ps(k1);
+	__m128 k2s = _mm_set1_ps(k2);
+	__m128 sign = _mm_set1_ps(-0.0f);
+	__m128i zero = _mm_setzero_si128();
+	for (; i + 4 <= end; i += 4) {
+		__m128 x = _mm_loadu_ps(vx + i);
+		__m128 y = _mm_loadu_ps(vy + i);
+		__m128 z = _mm_loadu_ps(vz + i);
+		__m128 speed = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+		__m128 coefficient = _mm_xor_ps(_mm_add_ps(k1s, _mm_mul_ps(k2s, speed)), sign);
+
+		// Widen the awake flags to a lane mask
+		int flags;
+		std::memcpy(&flags, awake + i, 4);
+		__m128i lanes = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(flags), zero), zero);
+		coefficient = _mm_and_ps(coefficient, _mm_castsi128_ps(_mm_cmpgt_epi32(lanes, zero)));
+
+		_mm_storeu_ps(fx + i, _mm_add_ps(_mm_loadu_ps(fx + i), _mm_mul_ps(x, coefficient)));
+		_mm_storeu_ps(fy + i, _mm_add_ps(_mm_loadu_ps(fy + i), _mm_mul_ps(y, coefficient)));
+		_mm_storeu_ps(fz + i, _mm_add_ps(_mm_loadu_ps(fz + i), _mm_mul_ps(z, coefficient)));
+	}
+#endif
+	for (; i < end; ++i) {
+		real speed = real_sqrt(vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+		real coefficient = awake[i] ? -(k1 + k2 * speed) : 0;
+		fx[i] += vx[i] * coefficient;
+		fy[i] += vy[i] * coefficient;
+		fz[i] += vz[i] * coefficient;
+	}
+}
+
 ParticleSpring::ParticleSpring(Particle* other, real sc, real r1) : other(other), springConstant(sc), restLength(r1) 
 {
 }
 
 void ParticleSpring::updateForce(Particle* particle, real duration) {
-	Vector3 force;
-
-	particle->getPosition(&force);
-	force -= other->getPosition();
+	Vector3 force = particle->getSeparation(*other);
 
 	// Compute magnitude of the force
 	real magnitude = force.magnitude();
@@ -95,9 +506,7 @@ ParticleBungee::ParticleBungee(Particle* other, real sc, real rl) : other(other)
 
 void ParticleBungee::updateForce(Particle* particle, real duration) {
 	// Calculate the vector of the spring
-	Vector3 force;
-	particle->getPosition(&force);
-	force -= other->getPosition();
+	Vector3 force = particle->getSeparation(*other);
 
 	// Check if there' a compression
 	real magnitude = force.magnitude();
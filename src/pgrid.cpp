@@ -0,0 +1,150 @@
+#include <assert.h>
+#include <cmath>
+#include "cyclone/pgrid.h"
+
+using namespace cyclone;
+
+ParticleGrid::ParticleGrid(real cellSize) : bucketMask(0) {
+	setCellSize(cellSize);
+}
+
+void ParticleGrid::setCellSize(real cellSize) {
+	assert(cellSize > 0);
+	ParticleGrid::cellSize = cellSize;
+	inverseCellSize = ((real)1.0) / cellSize;
+}
+
+int ParticleGrid::getCell(position_real value) const {
+	return (int)std::floor(value * inverseCellSize);
+}
+
+void ParticleGrid::build(const ParticleStore& store) {
+	build(store.positionX.data(), store.positionY.data(), store.positionZ.data(), store.size());
+}
+
+void ParticleGrid::build(const position_real* x, const position_real* y, const position_real* z, unsigned count) {
+	// Power of two table with about two buckets per particle keeps the collisions rare
+	unsigned buckets = 1;
+	while (buckets < count * 2) {
+		buckets <<= 1;
+	}
+	bucketMask = buckets - 1;
+
+	cellX.resize(count);
+	cellY.resize(count);
+	cellZ.resize(count);
+	bucketOf.resize(count);
+	bucketStart.assign(buckets + 1, 0);
+
+	// Count the particles of each bucket
+	for (unsigned i = 0; i < count; ++i) {
+		cellX[i] = getCell(x[i]);
+		cellY[i] = getCell(y[i]);
+		cellZ[i] = getCell(z[i]);
+		bucketOf[i] = getBucket(cellX[i], cellY[i], cellZ[i]);
+		++bucketStart[bucketOf[i] + 1];
+	}
+
+	// Prefix sum gives the first entry of each bucket
+	for (unsigned b = 0; b < buckets; ++b) {
+		bucketStart[b + 1] += bucketStart[b];
+	}
+
+	// Scatter the particles in their bucket, bucketStart[b] is used as cursor then restored
+	sortedIndices.resize(count);
+	sortedCellX.resize(count);
+	sortedCellY.resize(count);
+	sortedCellZ.resize(count);
+	for (unsigned i = 0; i < count; ++i) {
+		unsigned entry = bucketStart[bucketOf[i]]++;
+		sortedIndices[entry] = i;
+		sortedCellX[entry] = cellX[i];
+		sortedCellY[entry] = cellY[i];
+		sortedCellZ[entry] = cellZ[i];
+	}
+	for (unsigned b = buckets; b > 0; --b) {
+		bucketStart[b] = bucketStart[b - 1];
+	}
+	bucketStart[0] = 0;
+}
+
+namespace {
+	// Half of the 26 neighbour cells: for two adjacent cells exactly one is in the other's list
+	const int forwardNeighbours[13][3] = {
+		{ 1, 0, 0 },
+		{ -1, 1, 0 }, { 0, 1, 0 }, { 1, 1, 0 },
+		{ -1, -1, 1 }, { 0, -1, 1 }, { 1, -1, 1 },
+		{ -1, 0, 1 }, { 0, 0, 1 }, { 1, 0, 1 },
+		{ -1, 1, 1 }, { 0, 1, 1 }, { 1, 1, 1 }
+	};
+}
+
+void ParticleGrid::findPairs(std::vector<ParticlePair>& pairs) const {
+	unsigned count = size();
+
+	// Walk the particles in sorted order, neighbours in the same cell are then close in memory
+	for (unsigned entry = 0; entry < count; ++entry) {
+		unsigned i = sortedIndices[entry];
+		int cx = sortedCellX[entry];
+		int cy = sortedCellY[entry];
+		int cz = sortedCellZ[entry];
+
+		// Same cell: only the entries after this one, so each pair is found once
+		unsigned bucket = bucketOf[i];
+		for (unsigned other = entry + 1; other < bucketStart[bucket + 1]; ++other) {
+			if (sortedCellX[other] == cx && sortedCellY[other] == cy && sortedCellZ[other] == cz) {
+				ParticlePair pair = { i, sortedIndices[other] };
+				pairs.push_back(pair);
+			}
+		}
+
+		// Adjacent cells
+		for (unsigned n = 0; n < 13; ++n) {
+			int nx = cx + forwardNeighbours[n][0];
+			int ny = cy + forwardNeighbours[n][1];
+			int nz = cz + forwardNeighbours[n][2];
+			unsigned neighbour = getBucket(nx, ny, nz);
+			for (unsigned other = bucketStart[neighbour]; other < bucketStart[neighbour + 1]; ++other) {
+				if (sortedCellX[other] == nx && sortedCellY[other] == ny && sortedCellZ[other] == nz) {
+					ParticlePair pair = { i, sortedIndices[other] };
+					pairs.push_back(pair);
+				}
+			}
+		}
+	}
+}
+
+ParticleCollisions::ParticleCollisions(ParticleStore* store, real radius, real restitution) :
+	store(store), radius(radius), restitution(restitution), grid(radius * 2)
+{
+}
+
+unsigned ParticleCollisions::addContact(ParticleContact* contact, unsigned limit) const {
+	grid.build(*store);
+	pairs.clear();
+	grid.findPairs(pairs);
+
+	real diameter = radius * 2;
+	unsigned used = 0;
+	for (unsigned p = 0; p < pairs.size() && used < limit; ++p) {
+		unsigned a = pairs[p].first;
+		unsigned b = pairs[p].second;
+
+		// Narrowphase: sphere against sphere
+		Vector3 normal = store->getSeparation(a, b);
+		real distanceSquared = normal.squareMagnitude();
+		if (distanceSquared >= diameter * diameter || distanceSquared <= 0) {
+			continue;
+		}
+		real distance = real_sqrt(distanceSquared);
+
+		contact->particle[0] = store->getParticle(a);
+		contact->particle[1] = store->getParticle(b);
+		contact->contactNormal = normal * (((real)1.0) / distance);
+		contact->penetration = diameter - distance;
+		contact->restitution = restitution;
+		++contact;
+		++used;
+	}
+	return used;
+}
\ No newline at end of file
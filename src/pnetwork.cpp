@@ -0,0 +1,267 @@
+#include <assert.h>
+#include "cyclone/pnetwork.h"
+
+using namespace cyclone;
+
+namespace {
+	// Marks the store indices that are not unknowns of the solve
+	const unsigned NO_UNKNOWN = 0xffffffff;
+
+	// Dot product of two vectors of unknowns, accumulated in double so long vectors do not lose precision
+	double dot(const std::vector<real>& a, const std::vector<real>& b) {
+		double sum = 0;
+		for (unsigned i = 0; i < a.size(); ++i) {
+			sum += (double)a[i] * b[i];
+		}
+		return sum;
+	}
+}
+
+ParticleSpringNetwork::ParticleSpringNetwork(ParticleStore* store, unsigned maxIterations, real tolerance) :
+	store(store), maxIterations(maxIterations), tolerance(tolerance), iterationsUsed(0), warmStart(false)
+{
+}
+
+unsigned ParticleSpringNetwork::addLink(Particle* first, Particle* second, real springConstant, real restLength) {
+	assert(first->getStore() == store && second->getStore() == store);
+	assert(first != second);
+
+	Link link;
+	link.particle[0] = first;
+	link.particle[1] = second;
+	link.springConstant = springConstant;
+	link.restLength = restLength;
+	links.push_back(link);
+	warmStart = false;
+	return (unsigned)links.size() - 1;
+}
+
+void ParticleSpringNetwork::removeLink(unsigned index) {
+	assert(index < links.size());
+	links[index] = links.back();
+	links.pop_back();
+	warmStart = false;
+}
+
+void ParticleSpringNetwork::removeAllFor(Particle* particle) {
+	for (unsigned i = 0; i < links.size();) {
+		if (links[i].particle[0] == particle || links[i].particle[1] == particle) {
+			removeLink(i);
+		}
+		else {
+			++i;
+		}
+	}
+}
+
+void ParticleSpringNetwork::clear() {
+	links.clear();
+	warmStart = false;
+}
+
+void ParticleSpringNetwork::multiply(const std::vector<real>& vector, std::vector<real>& result) const {
+	// Mass term
+	unsigned unknowns = (unsigned)storeIndex.size();
+	for (unsigned u = 0; u < unknowns; ++u) {
+		real mass = fixed[u] ? 0 : ((real)1.0) / inverseMass[u];
+		result[u * 3] = vector[u * 3] * mass;
+		result[u * 3 + 1] = vector[u * 3 + 1] * mass;
+		result[u * 3 + 2] = vector[u * 3 + 2] * mass;
+	}
+
+	// Stiffness term, each link adds h^2 B (p_a - p_b) to a and the opposite to b
+	for (unsigned l = 0; l < links.size(); ++l) {
+		unsigned a = linkUnknowns[l * 2] * 3;
+		unsigned b = linkUnknowns[l * 2 + 1] * 3;
+		real dx = vector[a] - vector[b];
+		real dy = vector[a + 1] - vector[b + 1];
+		real dz = vector[a + 2] - vector[b + 2];
+		real along = (directionX[l] * dx + directionY[l] * dy + directionZ[l] * dz) * stiffnessU[l];
+		real fx = dx * stiffnessI[l] + directionX[l] * along;
+		real fy = dy * stiffnessI[l] + directionY[l] * along;
+		real fz = dz * stiffnessI[l] + directionZ[l] * along;
+		result[a] += fx; result[a + 1] += fy; result[a + 2] += fz;
+		result[b] -= fx; result[b + 1] -= fy; result[b + 2] -= fz;
+	}
+
+	// Fixed particles do not move
+	for (unsigned u = 0; u < unknowns; ++u) {
+		if (fixed[u]) {
+			result[u * 3] = result[u * 3 + 1] = result[u * 3 + 2] = 0;
+		}
+	}
+}
+
+void ParticleSpringNetwork::updateForces(real duration) {
+	assert(duration > 0.0);
+	iterationsUsed = 0;
+	if (links.empty()) {
+		return;
+	}
+
+	// Number the particles of the links
+	if (unknownOf.size() < store->size()) {
+		unknownOf.resize(store->size(), NO_UNKNOWN);
+	}
+	storeIndex.clear();
+	linkUnknowns.resize(links.size() * 2);
+	for (unsigned l = 0; l < links.size(); ++l) {
+		for (unsigned end = 0; end < 2; ++end) {
+			unsigned index = links[l].particle[end]->getIndex();
+			if (unknownOf[index] == NO_UNKNOWN) {
+				unknownOf[index] = (unsigned)storeIndex.size();
+				storeIndex.push_back(index);
+			}
+			linkUnknowns[l * 2 + end] = unknownOf[index];
+		}
+	}
+
+	unsigned unknowns = (unsigned)storeIndex.size();
+	inverseMass.resize(unknowns);
+	fixed.resize(unknowns);
+	for (unsigned u = 0; u < unknowns; ++u) {
+		unsigned index = storeIndex[u];
+		inverseMass[u] = store->inverseMass[index];
+		fixed[u] = inverseMass[u] <= 0 || !store->isAwake(index);
+	}
+
+	// Right hand side h f - h^2 B (v_a - v_b), starting with the forces already accumulated
+	std::vector<real>& rhs = rightHandSide;
+	rhs.resize(unknowns * 3);
+	for (unsigned u = 0; u < unknowns; ++u) {
+		unsigned index = storeIndex[u];
+		real mass = fixed[u] ? 0 : ((real)1.0) / inverseMass[u];
+		rhs[u * 3] = (store->forceX[index] + store->accelerationX[index] * mass) * duration;
+		rhs[u * 3 + 1] = (store->forceY[index] + store->accelerationY[index] * mass) * duration;
+		rhs[u * 3 + 2] = (store->forceZ[index] + store->accelerationZ[index] * mass) * duration;
+	}
+
+	// Spring forces and stiffness of each link. The stiffness across the link is dropped when it is
+	// compressed, keeping the system positive definite
+	real squareDuration = duration * duration;
+	stiffnessI.resize(links.size());
+	stiffnessU.resize(links.size());
+	directionX.resize(links.size());
+	directionY.resize(links.size());
+	directionZ.resize(links.size());
+	for (unsigned l = 0; l < links.size(); ++l) {
+		const Link& link = links[l];
+		Vector3 separation = link.particle[0]->getSeparation(*link.particle[1]);
+		real length = separation.magnitude();
+
+		real across = 0;
+		if (length > 0) {
+			separation *= ((real)1.0) / length;
+			across = 1 - link.restLength / length;
+			if (across < 0) {
+				across = 0;
+			}
+		}
+		directionX[l] = separation.x;
+		directionY[l] = separation.y;
+		directionZ[l] = separation.z;
+		stiffnessI[l] = link.springConstant * across * squareDuration;
+		stiffnessU[l] = link.springConstant * (1 - across) * squareDuration;
+
+		unsigned a = linkUnknowns[l * 2] * 3;
+		unsigned b = linkUnknowns[l * 2 + 1] * 3;
+		Vector3 velocity = store->getVelocity(storeIndex[linkUnknowns[l * 2]]) - store->getVelocity(storeIndex[linkUnknowns[l * 2 + 1]]);
+		real along = (separation * velocity) * stiffnessU[l];
+		real force = -link.springConstant * (length - link.restLength) * duration;
+		real fx = separation.x * force - (velocity.x * stiffnessI[l] + separation.x * along);
+		real fy = separation.y * force - (velocity.y * stiffnessI[l] + separation.y * along);
+		real fz = separation.z * force - (velocity.z * stiffnessI[l] + separation.z * along);
+		rhs[a] += fx; rhs[a + 1] += fy; rhs[a + 2] += fz;
+		rhs[b] -= fx; rhs[b + 1] -= fy; rhs[b + 2] -= fz;
+	}
+
+	// Jacobi preconditioner
+	diagonal.resize(unknowns * 3);
+	for (unsigned u = 0; u < unknowns; ++u) {
+		real mass = fixed[u] ? 0 : ((real)1.0) / inverseMass[u];
+		diagonal[u * 3] = diagonal[u * 3 + 1] = diagonal[u * 3 + 2] = mass;
+	}
+	for (unsigned l = 0; l < links.size(); ++l) {
+		for (unsigned end = 0; end < 2; ++end) {
+			unsigned u = linkUnknowns[l * 2 + end] * 3;
+			diagonal[u] += stiffnessI[l] + stiffnessU[l] * directionX[l] * directionX[l];
+			diagonal[u + 1] += stiffnessI[l] + stiffnessU[l] * directionY[l] * directionY[l];
+			diagonal[u + 2] += stiffnessI[l] + stiffnessU[l] * directionZ[l] * directionZ[l];
+		}
+	}
+
+	for (unsigned u = 0; u < unknowns; ++u) {
+		if (fixed[u]) {
+			rhs[u * 3] = rhs[u * 3 + 1] = rhs[u * 3 + 2] = 0;
+		}
+	}
+	double rhsSquare = dot(rhs, rhs);
+
+	// Start from the last solution when the unknowns did not change
+	if (!warmStart || deltaV.size() != unknowns * 3) {
+		deltaV.assign(unknowns * 3, 0);
+	}
+	for (unsigned u = 0; u < unknowns; ++u) {
+		if (fixed[u]) {
+			deltaV[u * 3] = deltaV[u * 3 + 1] = deltaV[u * 3 + 2] = 0;
+		}
+	}
+	residual.resize(unknowns * 3);
+	multiply(deltaV, residual);
+	for (unsigned i = 0; i < unknowns * 3; ++i) {
+		residual[i] = rhs[i] - residual[i];
+	}
+
+	// Preconditioned conjugate gradient, fixed particles stay at zero in every vector
+	preconditioned.resize(unknowns * 3);
+	search.resize(unknowns * 3);
+	product.resize(unknowns * 3);
+	for (unsigned i = 0; i < unknowns * 3; ++i) {
+		preconditioned[i] = diagonal[i] > 0 ? residual[i] / diagonal[i] : 0;
+		search[i] = preconditioned[i];
+	}
+	double residualDotPreconditioned = dot(residual, preconditioned);
+	double threshold = rhsSquare * tolerance * tolerance;
+
+	while (iterationsUsed < maxIterations && dot(residual, residual) > threshold) {
+		multiply(search, product);
+		double curvature = dot(search, product);
+		if (curvature <= 0) {
+			break;
+		}
+
+		real alpha = (real)(residualDotPreconditioned / curvature);
+		for (unsigned i = 0; i < unknowns * 3; ++i) {
+			deltaV[i] += search[i] * alpha;
+			residual[i] -= product[i] * alpha;
+		}
+
+		for (unsigned i = 0; i < unknowns * 3; ++i) {
+			preconditioned[i] = diagonal[i] > 0 ? residual[i] / diagonal[i] : 0;
+		}
+		double next = dot(residual, preconditioned);
+		real beta = (real)(next / residualDotPreconditioned);
+		residualDotPreconditioned = next;
+		for (unsigned i = 0; i < unknowns * 3; ++i) {
+			search[i] = preconditioned[i] + search[i] * beta;
+		}
+		++iterationsUsed;
+	}
+	warmStart = true;
+
+	// Replace the accumulated forces by the one giving the velocity change, the integrator
+	// adds the constant acceleration back
+	real inverseDuration = ((real)1.0) / duration;
+	for (unsigned u = 0; u < unknowns; ++u) {
+		unsigned index = storeIndex[u];
+		unknownOf[index] = NO_UNKNOWN;
+		if (fixed[u]) {
+			continue;
+		}
+
+		real mass = ((real)1.0) / inverseMass[u];
+		store->forceX[index] = (deltaV[u * 3] * inverseDuration - store->accelerationX[index]) * mass;
+		store->forceY[index] = (deltaV[u * 3 + 1] * inverseDuration - store->accelerationY[index]) * mass;
+		store->forceZ[index] = (deltaV[u * 3 + 2] * inverseDuration - store->accelerationZ[index]) * mass;
+	}
+}
\ No newline at end of file
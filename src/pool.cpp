@@ -0,0 +1,87 @@
+#include <assert.h>
+#include <cstdint>
+#include "cyclone/pool.h"
+
+using namespace cyclone;
+
+NodePool::NodePool(unsigned nodesPerChunk) : freeList(0), nodeSize(0), nodesPerChunk(nodesPerChunk) {
+	assert(nodesPerChunk > 0);
+}
+
+NodePool::~NodePool() {
+	for (unsigned i = 0; i < chunks.size(); ++i) {
+		::operator delete(chunks[i]);
+	}
+}
+
+void* NodePool::allocate(size_t size, size_t count) {
+	if (count != 1 || !accepts(size)) {
+		return ::operator new(size * count);
+	}
+
+	// Carve a new chunk into free nodes
+	if (!freeList) {
+		unsigned char* chunk = (unsigned char*)::operator new(nodeSize * nodesPerChunk);
+		chunks.push_back(chunk);
+		for (unsigned i = nodesPerChunk; i > 0; --i) {
+			void* node = chunk + (i - 1) * nodeSize;
+			*(void**)node = freeList;
+			freeList = node;
+		}
+	}
+
+	void* node = freeList;
+	freeList = *(void**)node;
+	return node;
+}
+
+void NodePool::deallocate(void* pointer, size_t size, size_t count) {
+	if (count != 1 || !accepts(size)) {
+		::operator delete(pointer);
+		return;
+	}
+	*(void**)pointer = freeList;
+	freeList = pointer;
+}
+
+FrameArena::FrameArena(size_t blockSize) : blockSize(blockSize), currentBlock(0), offset(0), used(0) {
+}
+
+FrameArena::~FrameArena() {
+	for (unsigned i = 0; i < blocks.size(); ++i) {
+		delete[] blocks[i].data;
+	}
+}
+
+void* FrameArena::allocate(size_t size, size_t alignment) {
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+	// Look for room in the current block, then in the following ones kept from the previous frames
+	while (currentBlock < blocks.size()) {
+		Block& block = blocks[currentBlock];
+		uintptr_t start = ((uintptr_t)(block.data + offset) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+		size_t end = (size_t)(start - (uintptr_t)block.data) + size;
+		if (end <= block.size) {
+			used += end - offset;
+			offset = end;
+			return (void*)start;
+		}
+		++currentBlock;
+		offset = 0;
+	}
+
+	// Add a block, large enough for oversized allocations
+	Block block;
+	block.size = size + alignment > blockSize ? size + alignment : blockSize;
+	block.data = new unsigned char[block.size];
+	blocks.push_back(block);
+	currentBlock = (unsigned)blocks.size() - 1;
+	offset = 0;
+	return allocate(size, alignment);
+}
+
+void FrameArena::reset() {
+	currentBlock = 0;
+	offset = 0;
+	used = 0;
+}
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include <assert.h>
+#include <cmath>
+#include <limits>
+#include "cyclone/pquery.h"
+
+using namespace cyclone;
+
+namespace {
+	// Queries per task of the parallel batches
+	const unsigned QUERY_GRAIN = 64;
+}
+
+ParticleQuery::ParticleQuery(const ParticleStore* store, real particleRadius, real cellSize) :
+	store(store), radius(particleRadius), grid(cellSize > 0 ? cellSize : particleRadius * 2)
+{
+	assert(particleRadius > 0);
+	assert(grid.getCellSize() >= particleRadius);
+}
+
+void ParticleQuery::update() {
+	grid.build(*store);
+}
+
+bool ParticleQuery::raycast(const ParticleRay& ray, ParticleRayHit& hit) const {
+	hit.particle = NO_PARTICLE;
+	hit.distance = ray.maxDistance;
+	if (grid.size() == 0) {
+		return false;
+	}
+
+	const Vector3& origin = ray.origin;
+	const Vector3& direction = ray.direction;
+	real radiusSquared = radius * radius;
+
+	// Ray against the sphere of each particle of a cell, keeping the closest entry point
+	auto testCell = [&](int x, int y, int z) {
+		grid.forEachInCell(x, y, z, [&](unsigned i) {
+			real mx = (real)(origin.x - store->positionX[i]);
+			real my = (real)(origin.y - store->positionY[i]);
+			real mz = (real)(origin.z - store->positionZ[i]);
+			real b = mx * direction.x + my * direction.y + mz * direction.z;
+			real c = mx * mx + my * my + mz * mz - radiusSquared;
+			if (c > 0 && b > 0) {
+				return; // Outside and pointing away
+			}
+			real discriminant = b * b - c;
+			if (discriminant < 0) {
+				return;
+			}
+			real distance = -b - real_sqrt(discriminant);
+			if (distance < 0) {
+				distance = 0; // Starting inside the particle
+			}
+			if (distance < hit.distance || (distance == hit.distance && i < hit.particle)) {
+				hit.particle = i;
+				hit.distance = distance;
+			}
+		});
+	};
+
+	// Walk the cells crossed by the ray (Amanatides and Woo). A particle hit at some point of the ray
+	// has its centre within one radius of it, so in one of the 27 cells around the cell of that point
+	real cellSize = grid.getCellSize();
+	int cell[3] = { grid.getCell(origin.x), grid.getCell(origin.y), grid.getCell(origin.z) };
+	real start[3] = { origin.x, origin.y, origin.z };
+	real heading[3] = { direction.x, direction.y, direction.z };
+	int step[3];
+	real next[3]; // Distance along the ray to the next cell boundary on each axis
+	real delta[3]; // Distance between two boundaries on each axis
+	for (unsigned a = 0; a < 3; ++a) {
+		real d = heading[a];
+		if (d > 0) {
+			step[a] = 1;
+			next[a] = ((real)(cell[a] + 1) * cellSize - start[a]) / d;
+			delta[a] = cellSize / d;
+		}
+		else if (d < 0) {
+			step[a] = -1;
+			next[a] = ((real)cell[a] * cellSize - start[a]) / d;
+			delta[a] = -cellSize / d;
+		}
+		else {
+			step[a] = 0;
+			next[a] = std::numeric_limits<real>::infinity();
+			delta[a] = 0;
+		}
+	}
+
+	for (int x = -1; x <= 1; ++x) {
+		for (int y = -1; y <= 1; ++y) {
+			for (int z = -1; z <= 1; ++z) {
+				testCell(cell[0] + x, cell[1] + y, cell[2] + z);
+			}
+		}
+	}
+
+	for (;;) {
+		unsigned axis = next[0] < next[1] ? (next[0] < next[2] ? 0 : 2) : (next[1] < next[2] ? 1 : 2);
+
+		// Hits in the cells ahead are further than this boundary
+		if (next[axis] > hit.distance) {
+			break;
+		}
+		cell[axis] += step[axis];
+		next[axis] += delta[axis];
+
+		// Only the slab of 9 cells ahead of the new cell was not tested with the previous one
+		unsigned u = (axis + 1) % 3;
+		unsigned v = (axis + 2) % 3;
+		int neighbour[3];
+		neighbour[axis] = cell[axis] + step[axis];
+		for (int du = -1; du <= 1; ++du) {
+			for (int dv = -1; dv <= 1; ++dv) {
+				neighbour[u] = cell[u] + du;
+				neighbour[v] = cell[v] + dv;
+				testCell(neighbour[0], neighbour[1], neighbour[2]);
+			}
+		}
+	}
+
+	return hit.particle != NO_PARTICLE;
+}
+
+void ParticleQuery::raycast(const ParticleRay* rays, unsigned count, ParticleRayHit* hits) const {
+	for (unsigned i = 0; i < count; ++i) {
+		raycast(rays[i], hits[i]);
+	}
+}
+
+void ParticleQuery::raycast(const ParticleRay* rays, unsigned count, ParticleRayHit* hits, JobSystem& jobs) const {
+	jobs.parallelFor(count, QUERY_GRAIN, [this, rays, hits](unsigned begin, unsigned end) {
+		raycast(rays + begin, end - begin, hits + begin);
+	});
+}
+
+unsigned ParticleQuery::querySphere(const ParticleSphere& sphere, unsigned* results, unsigned maxResults) const {
+	real reach = sphere.radius + radius;
+	real reachSquared = reach * reach;
+	const Vector3& centre = sphere.centre;
+
+	int minimumX = grid.getCell(centre.x - reach), maximumX = grid.getCell(centre.x + reach);
+	int minimumY = grid.getCell(centre.y - reach), maximumY = grid.getCell(centre.y + reach);
+	int minimumZ = grid.getCell(centre.z - reach), maximumZ = grid.getCell(centre.z + reach);
+
+	unsigned found = 0;
+	grid.forEachInBox(minimumX, minimumY, minimumZ, maximumX, maximumY, maximumZ, [&](unsigned i) {
+		real dx = (real)(store->positionX[i] - centre.x);
+		real dy = (real)(store->positionY[i] - centre.y);
+		real dz = (real)(store->positionZ[i] - centre.z);
+		if (dx * dx + dy * dy + dz * dz <= reachSquared) {
+			if (found < maxResults) {
+				results[found] = i;
+			}
+			++found;
+		}
+	});
+	return found;
+}
+
+void ParticleQuery::querySphere(const ParticleSphere* spheres, unsigned count, unsigned* results, unsigned maxResults, unsigned* resultCounts) const {
+	for (unsigned i = 0; i < count; ++i) {
+		resultCounts[i] = querySphere(spheres[i], results + (size_t)i * maxResults, maxResults);
+	}
+}
+
+void ParticleQuery::querySphere(const ParticleSphere* spheres, unsigned count, unsigned* results, unsigned maxResults, unsigned* resultCounts, JobSystem& jobs) const {
+	jobs.parallelFor(count, QUERY_GRAIN, [this, spheres, results, maxResults, resultCounts](unsigned begin, unsigned end) {
+		querySphere(spheres + begin, end - begin, results + (size_t)begin * maxResults, maxResults, resultCounts + begin);
+	});
+}
\ No newline at end of file
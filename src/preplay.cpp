@@ -0,0 +1,423 @@
+#include <assert.h>
+#include <climits>
+#include <cstring>
+#include <limits>
+#include "cyclone/preplay.h"
+
+using namespace cyclone;
+
+namespace {
+	// Scaled values beyond 2^62 cannot be quantized, they are read back as NaN like the values that
+	// are not finite
+	const double QUANTIZED_LIMIT = 4611686018427387904.0;
+	const long long QUANTIZED_NAN = LLONG_MIN;
+
+	const unsigned MAX_VARINT_SIZE = 10;
+
+	long long quantize(double value, double scale) {
+		double scaled = value * scale;
+		if (!(scaled > -QUANTIZED_LIMIT && scaled < QUANTIZED_LIMIT)) {
+			return QUANTIZED_NAN;
+		}
+		return (long long)(scaled + (scaled >= 0 ? 0.5 : -0.5));
+	}
+
+	double dequantize(long long quantized, double precision) {
+		if (quantized == QUANTIZED_NAN) {
+			return std::numeric_limits<double>::quiet_NaN();
+		}
+		return quantized * precision;
+	}
+
+	// Weights of the last two frames in the prediction of a frame: nothing on a keyframe, the last
+	// frame on the next one, then linear extrapolation. Computed in unsigned arithmetic, which wraps
+	struct Predictor {
+		unsigned long long previousWeight;
+		unsigned long long beforePreviousWeight;
+
+		Predictor(unsigned history) :
+			previousWeight(history == 0 ? 0 : history == 1 ? 1 : 2), beforePreviousWeight(history >= 2 ? 1 : 0)
+		{
+		}
+
+		unsigned long long predict(long long previous, long long beforePrevious) const {
+			return previousWeight * (unsigned long long)previous - beforePreviousWeight * (unsigned long long)beforePrevious;
+		}
+	};
+
+	// Small differences of either sign become small unsigned values
+	unsigned long long zigzag(unsigned long long value) {
+		return (value << 1) ^ (0 - (value >> 63));
+	}
+
+	unsigned long long unzigzag(unsigned long long value) {
+		return (value >> 1) ^ (0 - (value & 1));
+	}
+
+	// Seven bits per byte, the high bit set on all the bytes but the last
+	unsigned char* putVarint(unsigned char* out, unsigned long long value) {
+		while (value >= 0x80) {
+			*out++ = (unsigned char)(value | 0x80);
+			value >>= 7;
+		}
+		*out++ = (unsigned char)value;
+		return out;
+	}
+
+	const unsigned char* getVarint(const unsigned char* in, const unsigned char* end, unsigned long long& value) {
+		value = 0;
+		for (unsigned shift = 0; in < end && shift < 64; shift += 7) {
+			unsigned char byte = *in++;
+			value |= (unsigned long long)(byte & 0x7f) << shift;
+			if (byte < 0x80) {
+				return in;
+			}
+		}
+		return 0;
+	}
+
+	template<class T>
+	unsigned char* encodeChannel(const std::vector<T>& values, double scale, const Predictor& predictor,
+		std::vector<long long>& previous, std::vector<long long>& beforePrevious, unsigned char* out)
+	{
+		for (size_t i = 0; i < values.size(); ++i) {
+			long long quantized = quantize(values[i], scale);
+			out = putVarint(out, zigzag((unsigned long long)quantized - predictor.predict(previous[i], beforePrevious[i])));
+			beforePrevious[i] = previous[i];
+			previous[i] = quantized;
+		}
+		return out;
+	}
+
+	const unsigned char* decodeChannel(const unsigned char* in, const unsigned char* end, unsigned count, const Predictor& predictor,
+		std::vector<long long>& previous, std::vector<long long>& beforePrevious)
+	{
+		for (unsigned i = 0; i < count && in; ++i) {
+			unsigned long long value;
+			in = getVarint(in, end, value);
+			long long quantized = (long long)(unzigzag(value) + predictor.predict(previous[i], beforePrevious[i]));
+			beforePrevious[i] = previous[i];
+			previous[i] = quantized;
+		}
+		return in;
+	}
+
+	template<class T>
+	void dequantizeChannel(const std::vector<long long>& quantized, double precision, std::vector<T>& values) {
+		values.resize(quantized.size());
+		for (size_t i = 0; i < quantized.size(); ++i) {
+			values[i] = (T)dequantize(quantized[i], precision);
+		}
+	}
+
+	// 64 bit file offsets, long is 32 bits on Windows
+	bool seekFile(FILE* file, long long offset, int origin) {
+#if defined(_WIN32)
+		return _fseeki64(file, offset, origin) == 0;
+#else
+		return fseeko(file, (off_t)offset, origin) == 0;
+#endif
+	}
+
+	long long tellFile(FILE* file) {
+#if defined(_WIN32)
+		return _ftelli64(file);
+#else
+		return (long long)ftello(file);
+#endif
+	}
+}
+
+ParticleReplayRecorder::ParticleReplayRecorder(unsigned bufferFrames) :
+	ring(bufferFrames), readIndex(0), queued(0), stopping(false), file(0), time(0), frameCount(0), failed(false),
+	history(0), lastCount(0)
+{
+	assert(bufferFrames > 0);
+	std::memset(&header, 0, sizeof(header));
+}
+
+ParticleReplayRecorder::~ParticleReplayRecorder() {
+	close();
+}
+
+bool ParticleReplayRecorder::open(const char* filename, double positionPrecision, double velocityPrecision,
+	unsigned keyframeInterval, bool recordVelocities)
+{
+	assert(positionPrecision > 0 && velocityPrecision > 0);
+	assert(keyframeInterval > 0);
+	close();
+
+	file = std::fopen(filename, "wb");
+	if (!file) {
+		return false;
+	}
+
+	std::memcpy(header.magic, "CYRP", 4);
+	header.version = REPLAY_VERSION;
+	header.channelCount = recordVelocities ? 6 : 3;
+	header.keyframeInterval = keyframeInterval;
+	header.positionPrecision = positionPrecision;
+	header.velocityPrecision = velocityPrecision;
+	if (std::fwrite(&header, sizeof(header), 1, file) != 1) {
+		std::fclose(file);
+		file = 0;
+		return false;
+	}
+
+	readIndex = 0;
+	queued = 0;
+	stopping = false;
+	time = 0;
+	frameCount = 0;
+	failed = false;
+	history = 0;
+	lastCount = UINT_MAX; // The first frame is a keyframe
+	writer = std::thread(&ParticleReplayRecorder::writerLoop, this);
+	return true;
+}
+
+bool ParticleReplayRecorder::close() {
+	if (!file) {
+		return true;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	frameQueued.notify_one();
+	writer.join();
+
+	bool written = std::fclose(file) == 0 && !failed;
+	file = 0;
+	return written;
+}
+
+void ParticleReplayRecorder::record(const ParticleStore& particles, real duration) {
+	if (!file) {
+		return;
+	}
+	time += duration;
+
+	// The slot after the queued frames belongs to this thread until it is queued
+	unsigned slot;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		frameWritten.wait(lock, [this] { return queued < ring.size(); });
+		slot = (readIndex + queued) % (unsigned)ring.size();
+	}
+
+	// The buffers keep their capacity, so recording does not allocate once the ring has warmed up
+	Frame& frame = ring[slot];
+	frame.time = time;
+	frame.positionX.assign(particles.positionX.begin(), particles.positionX.end());
+	frame.positionY.assign(particles.positionY.begin(), particles.positionY.end());
+	frame.positionZ.assign(particles.positionZ.begin(), particles.positionZ.end());
+	if (header.channelCount == 6) {
+		frame.velocityX.assign(particles.velocityX.begin(), particles.velocityX.end());
+		frame.velocityY.assign(particles.velocityY.begin(), particles.velocityY.end());
+		frame.velocityZ.assign(particles.velocityZ.begin(), particles.velocityZ.end());
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++queued;
+	}
+	frameQueued.notify_one();
+	++frameCount;
+}
+
+void ParticleReplayRecorder::writerLoop() {
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		frameQueued.wait(lock, [this] { return queued > 0 || stopping; });
+		if (queued == 0) {
+			break;
+		}
+
+		// Encode without the lock, the simulation thread keeps filling the other slots
+		const Frame& frame = ring[readIndex];
+		lock.unlock();
+		if (!failed && !writeFrame(frame)) {
+			failed = true;
+		}
+		lock.lock();
+
+		readIndex = (readIndex + 1) % (unsigned)ring.size();
+		--queued;
+		frameWritten.notify_one();
+	}
+}
+
+bool ParticleReplayRecorder::writeFrame(const Frame& frame) {
+	unsigned count = (unsigned)frame.positionX.size();
+	unsigned channels = header.channelCount;
+
+	if (history >= header.keyframeInterval || count != lastCount) {
+		history = 0;
+	}
+	if (history == 0) {
+		for (unsigned c = 0; c < channels; ++c) {
+			previous[c].assign(count, 0);
+			beforePrevious[c].assign(count, 0);
+		}
+	}
+
+	if (payload.size() < (size_t)count * channels * MAX_VARINT_SIZE) {
+		payload.resize((size_t)count * channels * MAX_VARINT_SIZE);
+	}
+	Predictor predictor(history);
+	double positionScale = 1 / header.positionPrecision;
+	double velocityScale = 1 / header.velocityPrecision;
+	unsigned char* out = payload.data();
+	out = encodeChannel(frame.positionX, positionScale, predictor, previous[0], beforePrevious[0], out);
+	out = encodeChannel(frame.positionY, positionScale, predictor, previous[1], beforePrevious[1], out);
+	out = encodeChannel(frame.positionZ, positionScale, predictor, previous[2], beforePrevious[2], out);
+	if (channels == 6) {
+		out = encodeChannel(frame.velocityX, velocityScale, predictor, previous[3], beforePrevious[3], out);
+		out = encodeChannel(frame.velocityY, velocityScale, predictor, previous[4], beforePrevious[4], out);
+		out = encodeChannel(frame.velocityZ, velocityScale, predictor, previous[5], beforePrevious[5], out);
+	}
+
+	ParticleReplayFrameHeader frameHeader;
+	frameHeader.flags = history == 0 ? REPLAY_KEYFRAME : 0;
+	frameHeader.particleCount = count;
+	frameHeader.time = frame.time;
+	frameHeader.payloadSize = (unsigned long long)(out - payload.data());
+
+	++history;
+	lastCount = count;
+	return std::fwrite(&frameHeader, sizeof(frameHeader), 1, file) == 1 &&
+		std::fwrite(payload.data(), 1, (size_t)frameHeader.payloadSize, file) == frameHeader.payloadSize;
+}
+
+ParticleReplayReader::ParticleReplayReader() : file(0), current(0) {
+	std::memset(&header, 0, sizeof(header));
+}
+
+ParticleReplayReader::~ParticleReplayReader() {
+	close();
+}
+
+bool ParticleReplayReader::open(const char* filename) {
+	close();
+
+	file = std::fopen(filename, "rb");
+	if (!file) {
+		return false;
+	}
+
+	long long size = -1;
+	if (seekFile(file, 0, SEEK_END)) {
+		size = tellFile(file);
+	}
+	if (size < (long long)sizeof(header) || !seekFile(file, 0, SEEK_SET) || std::fread(&header, sizeof(header), 1, file) != 1 ||
+		std::memcmp(header.magic, "CYRP", 4) != 0 || header.version != REPLAY_VERSION ||
+		(header.channelCount != 3 && header.channelCount != 6))
+	{
+		close();
+		return false;
+	}
+
+	// Index the frames from their headers, stopping at the first incomplete or inconsistent one
+	long long offset = sizeof(header);
+	FrameEntry entry;
+	while (offset + (long long)sizeof(entry.header) <= size) {
+		if (!seekFile(file, offset, SEEK_SET) || std::fread(&entry.header, sizeof(entry.header), 1, file) != 1) {
+			break;
+		}
+		entry.offset = offset + sizeof(entry.header);
+		if (entry.header.payloadSize > (unsigned long long)(size - entry.offset)) {
+			break;
+		}
+		if (entry.header.flags & REPLAY_KEYFRAME) {
+			entry.keyframe = (unsigned)frames.size();
+		}
+		else if (frames.empty() || frames.back().header.particleCount != entry.header.particleCount) {
+			break;
+		}
+		else {
+			entry.keyframe = frames.back().keyframe;
+		}
+		frames.push_back(entry);
+		offset = entry.offset + (long long)entry.header.payloadSize;
+	}
+
+	current = (unsigned)frames.size();
+	return true;
+}
+
+void ParticleReplayReader::close() {
+	if (file) {
+		std::fclose(file);
+		file = 0;
+	}
+	frames.clear();
+	current = 0;
+}
+
+bool ParticleReplayReader::decodeFrame(unsigned index) {
+	const FrameEntry& entry = frames[index];
+	unsigned count = entry.header.particleCount;
+	unsigned channels = header.channelCount;
+
+	payload.resize((size_t)entry.header.payloadSize);
+	if (!seekFile(file, entry.offset, SEEK_SET) || std::fread(payload.data(), 1, payload.size(), file) != payload.size()) {
+		return false;
+	}
+
+	if (index == entry.keyframe) {
+		for (unsigned c = 0; c < channels; ++c) {
+			previous[c].assign(count, 0);
+			beforePrevious[c].assign(count, 0);
+		}
+	}
+
+	Predictor predictor(index - entry.keyframe);
+	const unsigned char* in = payload.data();
+	const unsigned char* end = in + payload.size();
+	for (unsigned c = 0; c < channels && in; ++c) {
+		in = decodeChannel(in, end, count, predictor, previous[c], beforePrevious[c]);
+	}
+	if (in != end) {
+		return false;
+	}
+
+	current = index;
+	return true;
+}
+
+bool ParticleReplayReader::readFrame(unsigned index, ParticleReplayFrame& frame) {
+	if (index >= frames.size()) {
+		return false;
+	}
+
+	// Go on from the frame decoded last when it is on the way, otherwise start from the keyframe
+	unsigned start = frames[index].keyframe;
+	if (current < frames.size() && current <= index && current >= start) {
+		start = current + 1;
+	}
+	for (unsigned f = start; f <= index; ++f) {
+		if (!decodeFrame(f)) {
+			current = (unsigned)frames.size();
+			return false;
+		}
+	}
+
+	frame.time = frames[index].header.time;
+	frame.particleCount = frames[index].header.particleCount;
+	dequantizeChannel(previous[0], header.positionPrecision, frame.positionX);
+	dequantizeChannel(previous[1], header.positionPrecision, frame.positionY);
+	dequantizeChannel(previous[2], header.positionPrecision, frame.positionZ);
+	if (hasVelocities()) {
+		dequantizeChannel(previous[3], header.velocityPrecision, frame.velocityX);
+		dequantizeChannel(previous[4], header.velocityPrecision, frame.velocityY);
+		dequantizeChannel(previous[5], header.velocityPrecision, frame.velocityZ);
+	}
+	else {
+		frame.velocityX.clear();
+		frame.velocityY.clear();
+		frame.velocityZ.clear();
+	}
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,145 @@
+#include <atomic>
+#include <cstdio>
+#include "cyclone/profile.h"
+
+using namespace cyclone;
+
+namespace {
+	// Small thread ids for the trace, in order of first use
+	std::atomic<unsigned> nextThreadId(0);
+
+	unsigned getThreadId() {
+		static thread_local unsigned id = nextThreadId++;
+		return id;
+	}
+}
+
+void ProfileStats::clear() {
+	for (unsigned p = 0; p < PROFILE_PHASE_COUNT; ++p) {
+		phaseTime[p] = 0;
+		phaseCalls[p] = 0;
+	}
+	for (unsigned g = 0; g < PROFILE_GENERATOR_COUNT; ++g) {
+		generatorCalls[g] = 0;
+		generatorTime[g] = 0;
+	}
+	particles = 0;
+	awakeParticles = 0;
+	registrations = 0;
+	contacts = 0;
+}
+
+Profiler::Profiler() : epoch(std::chrono::steady_clock::now()), tracing(false), maxTraceEvents(0) {
+}
+
+Profiler& Profiler::get() {
+	static Profiler profiler;
+	return profiler;
+}
+
+ProfileStats Profiler::getStats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+void Profiler::reset() {
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.clear();
+}
+
+void Profiler::addPhase(ProfilePhase phase, double start, double duration) {
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.phaseTime[phase] += duration;
+	++stats.phaseCalls[phase];
+
+	if (tracing) {
+		if (traceEvents.size() < maxTraceEvents) {
+			TraceEvent event = { (unsigned)phase, getThreadId(), start, duration };
+			traceEvents.push_back(event);
+		}
+		else {
+			tracing = false;
+		}
+	}
+}
+
+void Profiler::addGenerator(ProfileGenerator generator, unsigned calls, double duration) {
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.generatorCalls[generator] += calls;
+	stats.generatorTime[generator] += duration;
+}
+
+void Profiler::setCounters(unsigned particles, unsigned awakeParticles, unsigned registrations, unsigned contacts) {
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.particles = particles;
+	stats.awakeParticles = awakeParticles;
+	stats.registrations = registrations;
+	stats.contacts = contacts;
+
+	if (tracing && traceCounters.size() < maxTraceEvents) {
+		TraceCounters sample = { now(), particles, awakeParticles, contacts };
+		traceCounters.push_back(sample);
+	}
+}
+
+void Profiler::startTrace(unsigned maxEvents) {
+	std::lock_guard<std::mutex> lock(mutex);
+	traceEvents.clear();
+	traceCounters.clear();
+	maxTraceEvents = maxEvents;
+	tracing = true;
+}
+
+void Profiler::stopTrace() {
+	std::lock_guard<std::mutex> lock(mutex);
+	tracing = false;
+}
+
+bool Profiler::isTracing() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return tracing;
+}
+
+bool Profiler::writeTrace(const char* filename) const {
+	FILE* file = std::fopen(filename, "w");
+	if (!file) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Complete events ("X") for the scopes and counter events ("C"), timestamps in microseconds
+	std::fprintf(file, "{\"traceEvents\":[\n");
+	bool first = true;
+	for (unsigned i = 0; i < traceEvents.size(); ++i) {
+		const TraceEvent& event = traceEvents[i];
+		std::fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"cyclone\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+			first ? "" : ",\n", getPhaseName((ProfilePhase)event.phase), event.thread, event.start * 1e6, event.duration * 1e6);
+		first = false;
+	}
+	for (unsigned i = 0; i < traceCounters.size(); ++i) {
+		const TraceCounters& sample = traceCounters[i];
+		std::fprintf(file, "%s{\"name\":\"particles\",\"cat\":\"cyclone\",\"ph\":\"C\",\"pid\":0,\"ts\":%.3f,"
+			"\"args\":{\"awake\":%u,\"asleep\":%u,\"contacts\":%u}}",
+			first ? "" : ",\n", sample.time * 1e6, sample.awakeParticles, sample.particles - sample.awakeParticles, sample.contacts);
+		first = false;
+	}
+	std::fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+	return std::fclose(file) == 0;
+}
+
+const char* Profiler::getPhaseName(ProfilePhase phase) {
+	static const char* names[PROFILE_PHASE_COUNT] = {
+		"frame", "step", "forces", "integration", "contact generation", "contact resolution", "query"
+	};
+	return names[phase];
+}
+
+const char* Profiler::getGeneratorName(ProfileGenerator generator) {
+	static const char* names[PROFILE_GENERATOR_COUNT] = {
+		"ParticleGravity", "ParticleDrag", "ParticleSpring", "ParticleAnchoredSpring",
+		"ParticleBungee", "ParticleBuoyancy", "generic"
+	};
+	return names[generator];
+}
\ No newline at end of file
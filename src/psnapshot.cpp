@@ -0,0 +1,468 @@
+#include <assert.h>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <unordered_map>
+#include "cyclone/psnapshot.h"
+#include "cyclone/pworld.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define CYCLONE_SNAPSHOT_MMAP
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+using namespace cyclone;
+
+namespace {
+	const size_t SECTION_ALIGNMENT = 64;
+
+	size_t align(size_t offset) {
+		return (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+	}
+
+	// Call visit(section, array) for each per particle array of the store, in section order
+	template<class Store, class Visitor>
+	void forEachArray(Store& store, Visitor visit) {
+		visit(SNAPSHOT_POSITION_X, store.positionX); visit(SNAPSHOT_POSITION_Y, store.positionY); visit(SNAPSHOT_POSITION_Z, store.positionZ);
+		visit(SNAPSHOT_VELOCITY_X, store.velocityX); visit(SNAPSHOT_VELOCITY_Y, store.velocityY); visit(SNAPSHOT_VELOCITY_Z, store.velocityZ);
+		visit(SNAPSHOT_ACCELERATION_X, store.accelerationX); visit(SNAPSHOT_ACCELERATION_Y, store.accelerationY); visit(SNAPSHOT_ACCELERATION_Z, store.accelerationZ);
+		visit(SNAPSHOT_FORCE_X, store.forceX); visit(SNAPSHOT_FORCE_Y, store.forceY); visit(SNAPSHOT_FORCE_Z, store.forceZ);
+		visit(SNAPSHOT_INVERSE_MASS, store.inverseMass);
+		visit(SNAPSHOT_MASS, store.mass);
+		visit(SNAPSHOT_DAMPING, store.damping);
+		visit(SNAPSHOT_MOTION, store.motion);
+		visit(SNAPSHOT_AWAKE, store.awake);
+		visit(SNAPSHOT_CAN_SLEEP, store.canSleep);
+	}
+
+	// Unsigned integer of the same size as a value, to compare values bit for bit
+	template<size_t Size> struct Bits;
+	template<> struct Bits<1> { typedef unsigned char Type; };
+	template<> struct Bits<4> { typedef unsigned int Type; };
+	template<> struct Bits<8> { typedef unsigned long long Type; };
+
+	size_t getElementSize(unsigned section) {
+		switch (section) {
+		case SNAPSHOT_INDEX:
+			return sizeof(unsigned);
+		case SNAPSHOT_POSITION_X: case SNAPSHOT_POSITION_Y: case SNAPSHOT_POSITION_Z:
+			return sizeof(position_real);
+		case SNAPSHOT_AWAKE: case SNAPSHOT_CAN_SLEEP:
+			return sizeof(unsigned char);
+		case SNAPSHOT_REGISTRATIONS:
+			return sizeof(unsigned) * 2;
+		default:
+			return sizeof(real);
+		}
+	}
+
+	size_t getElementCount(const ParticleSnapshotHeader& header, unsigned section) {
+		switch (section) {
+		case SNAPSHOT_INDEX:
+			return (header.flags & SNAPSHOT_DELTA) ? header.recordCount : 0;
+		case SNAPSHOT_REGISTRATIONS:
+			return (header.flags & SNAPSHOT_SAME_REGISTRATIONS) ? 0 : header.registrationCount;
+		default:
+			return header.recordCount;
+		}
+	}
+
+	// Set the offsets of the sections, return the size of the snapshot
+	size_t computeLayout(ParticleSnapshotHeader& header) {
+		size_t offset = align(sizeof(ParticleSnapshotHeader));
+		for (unsigned s = 0; s < SNAPSHOT_SECTION_COUNT; ++s) {
+			header.sections[s] = offset;
+			offset = align(offset + getElementCount(header, s) * getElementSize(s));
+		}
+		return offset;
+	}
+
+	// Hash of everything a snapshot saves, the arrays in section order, the registrations as pairs of
+	// indices and the accumulator. The base check of the deltas
+	unsigned long long hashContent(const ParticleStore& store, const std::vector<unsigned>& registrations, double accumulator) {
+		StateHash hash;
+		forEachArray(store, [&hash](unsigned, const auto& values) {
+			hash.add(values);
+		});
+		hash.add(registrations);
+		hash.add(&accumulator, sizeof(accumulator));
+		return hash.get();
+	}
+
+	// Registrations of the world as pairs of particle index and index in the table, false if a generator
+	// is not in the table
+	bool getRegistrationIndices(const ParticleWorld& world, const GeneratorTable& generators, std::vector<unsigned>& indices) {
+		std::unordered_map<ParticleForceGenerator*, unsigned> generatorIndex;
+		for (unsigned g = 0; g < generators.size(); ++g) {
+			generatorIndex.insert(std::make_pair(generators[g], g));
+		}
+
+		std::vector<Particle*> particles;
+		std::vector<ParticleForceGenerator*> registered;
+		world.getForceRegistry().getRegistrations(particles, registered);
+		indices.resize(particles.size() * 2);
+		for (unsigned r = 0; r < particles.size(); ++r) {
+			std::unordered_map<ParticleForceGenerator*, unsigned>::const_iterator g = generatorIndex.find(registered[r]);
+			if (g == generatorIndex.end()) {
+				return false;
+			}
+			indices[r * 2] = particles[r]->getIndex();
+			indices[r * 2 + 1] = g->second;
+		}
+		return true;
+	}
+
+	// Write the bytes at the given offset of the file, padding from the current position
+	bool writeAt(FILE* file, size_t& position, size_t offset, const void* data, size_t size) {
+		static const unsigned char zeros[SECTION_ALIGNMENT] = {};
+		assert(offset >= position && offset - position <= SECTION_ALIGNMENT);
+		if (offset > position && std::fwrite(zeros, 1, offset - position, file) != offset - position) {
+			return false;
+		}
+		position = offset + size;
+		return size == 0 || std::fwrite(data, 1, size, file) == size;
+	}
+}
+
+ParticleSnapshotView::ParticleSnapshotView(const void* data, size_t size) : data((const unsigned char*)data), size(size) {
+}
+
+bool ParticleSnapshotView::isValid() const {
+	if (!data || size < sizeof(ParticleSnapshotHeader)) {
+		return false;
+	}
+
+	const ParticleSnapshotHeader& header = getHeader();
+	if (std::memcmp(header.magic, "CYPS", 4) != 0 || header.version != SNAPSHOT_VERSION ||
+		header.realSize != sizeof(real) || header.positionSize != sizeof(position_real)) {
+		return false;
+	}
+	if (header.flags & ~(unsigned)(SNAPSHOT_DELTA | SNAPSHOT_SAME_REGISTRATIONS)) {
+		return false;
+	}
+	if (!(header.flags & SNAPSHOT_DELTA) && header.recordCount != header.particleCount) {
+		return false;
+	}
+	if (header.recordCount > header.particleCount) {
+		return false;
+	}
+
+	// The layout follows from the counts
+	ParticleSnapshotHeader expected = header;
+	if (computeLayout(expected) > size) {
+		return false;
+	}
+	return std::memcmp(expected.sections, header.sections, sizeof(header.sections)) == 0;
+}
+
+bool ParticleSnapshotView::restore(ParticleWorld& world, const GeneratorTable& generators) const {
+	if (!isValid()) {
+		return false;
+	}
+	const ParticleSnapshotHeader& header = getHeader();
+	bool delta = (header.flags & SNAPSHOT_DELTA) != 0;
+	bool sameRegistrations = (header.flags & SNAPSHOT_SAME_REGISTRATIONS) != 0;
+
+	// Check everything before touching the world. The content hash covers every field a delta leaves
+	// alone and the registrations a delta with the same registrations does not carry
+	if (delta) {
+		std::vector<unsigned> current;
+		if (!getRegistrationIndices(world, generators, current) ||
+			hashContent(world.getParticles(), current, world.getAccumulator()) != header.baseContentHash) {
+			return false;
+		}
+	}
+	const unsigned* indices = (const unsigned*)getSection(SNAPSHOT_INDEX);
+	if (delta) {
+		for (unsigned r = 0; r < header.recordCount; ++r) {
+			if (indices[r] >= header.particleCount || (r > 0 && indices[r] <= indices[r - 1])) {
+				return false;
+			}
+		}
+	}
+	const unsigned* registrations = (const unsigned*)getSection(SNAPSHOT_REGISTRATIONS);
+	if (!sameRegistrations) {
+		for (unsigned r = 0; r < header.registrationCount; ++r) {
+			if (registrations[r * 2] >= header.particleCount || registrations[r * 2 + 1] >= generators.size()) {
+				return false;
+			}
+		}
+	}
+
+	// Rolling back usually finds the registrations unchanged, which a pointer comparison tells
+	ParticleForceRegistry& registry = world.getForceRegistry();
+	ParticleStore& store = world.getParticles();
+	if (!sameRegistrations && registry.size() == header.registrationCount && store.size() == header.particleCount) {
+		std::vector<Particle*> currentParticles;
+		std::vector<ParticleForceGenerator*> currentGenerators;
+		currentParticles.reserve(header.registrationCount);
+		currentGenerators.reserve(header.registrationCount);
+		registry.getRegistrations(currentParticles, currentGenerators);
+		sameRegistrations = true;
+		for (unsigned r = 0; r < header.registrationCount && sameRegistrations; ++r) {
+			sameRegistrations = currentParticles[r] == store.getParticle(registrations[r * 2]) &&
+				currentGenerators[r] == generators[registrations[r * 2 + 1]];
+		}
+	}
+
+	// Match the particle count, keeping the handles of the first particles
+	if (!sameRegistrations) {
+		registry.clear();
+	}
+	while (store.size() > header.particleCount) {
+		world.destroyParticle(store.getParticle(store.size() - 1));
+	}
+	while (store.size() < header.particleCount) {
+		world.createParticle();
+	}
+
+	// Copy the arrays, or scatter the records of a delta
+	forEachArray(store, [this, &header, delta, indices](unsigned section, auto& values) {
+		typedef typename std::decay<decltype(values[0])>::type Value;
+		const Value* saved = (const Value*)getSection(section);
+		if (!delta) {
+			std::memcpy(values.data(), saved, header.recordCount * sizeof(Value));
+			return;
+		}
+		for (unsigned r = 0; r < header.recordCount; ++r) {
+			values[indices[r]] = saved[r];
+		}
+	});
+
+	if (!sameRegistrations) {
+		for (unsigned r = 0; r < header.registrationCount; ++r) {
+			registry.add(store.getParticle(registrations[r * 2]), generators[registrations[r * 2 + 1]]);
+		}
+	}
+
+	world.setAccumulator((real)header.accumulator);
+
+	// The arrays were copied behind the back of the world, its query must see the restored positions
+	world.markParticlesChanged();
+	return true;
+}
+
+ParticleSnapshotFile::ParticleSnapshotFile() : mapping(0), mappingSize(0) {
+}
+
+ParticleSnapshotFile::~ParticleSnapshotFile() {
+	close();
+}
+
+bool ParticleSnapshotFile::open(const char* filename) {
+	close();
+
+#if defined(CYCLONE_SNAPSHOT_MMAP)
+	int descriptor = ::open(filename, O_RDONLY);
+	if (descriptor < 0) {
+		return false;
+	}
+	struct stat status;
+	if (fstat(descriptor, &status) != 0 || status.st_size == 0) {
+		::close(descriptor);
+		return false;
+	}
+	int flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+	// Read the file ahead in one go rather than faulting it in page by page during the restore
+	flags |= MAP_POPULATE;
+#endif
+	void* address = mmap(0, (size_t)status.st_size, PROT_READ, flags, descriptor, 0);
+	::close(descriptor);
+	if (address == MAP_FAILED) {
+		return false;
+	}
+	mapping = address;
+	mappingSize = (size_t)status.st_size;
+	data = (const unsigned char*)mapping;
+	size = mappingSize;
+#else
+	// Read the whole file, the arrays are still used in place
+	FILE* file = std::fopen(filename, "rb");
+	if (!file) {
+		return false;
+	}
+	bool read = std::fseek(file, 0, SEEK_END) == 0;
+	long length = read ? std::ftell(file) : -1;
+	read = length > 0 && std::fseek(file, 0, SEEK_SET) == 0;
+	if (read) {
+		buffer.resize((size_t)length);
+		read = std::fread(buffer.data(), 1, buffer.size(), file) == buffer.size();
+	}
+	std::fclose(file);
+	if (!read) {
+		buffer.clear();
+		return false;
+	}
+	data = buffer.data();
+	size = buffer.size();
+#endif
+
+	if (!isValid()) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void ParticleSnapshotFile::close() {
+#if defined(CYCLONE_SNAPSHOT_MMAP)
+	if (mapping) {
+		munmap(mapping, mappingSize);
+	}
+#endif
+	mapping = 0;
+	mappingSize = 0;
+	buffer.clear();
+	data = 0;
+	size = 0;
+}
+
+ParticleSnapshotWriter::ParticleSnapshotWriter() : baseCount(0), baseContentHash(0), hasBase(false), lastRecordCount(0) {
+}
+
+bool ParticleSnapshotWriter::buildRegistrations(const ParticleWorld& world, const GeneratorTable& generators) {
+	// The table rarely changes between snapshots, index it again only when it does
+	if (generators != indexedTable) {
+		indexedTable = generators;
+		generatorIndex.clear();
+		for (unsigned g = 0; g < generators.size(); ++g) {
+			generatorIndex.insert(std::make_pair(generators[g], g));
+		}
+	}
+
+	registeredParticles.clear();
+	registeredGenerators.clear();
+	world.getForceRegistry().getRegistrations(registeredParticles, registeredGenerators);
+
+	currentRegistrations.resize(registeredParticles.size() * 2);
+	for (unsigned r = 0; r < registeredParticles.size(); ++r) {
+		GeneratorIndex::const_iterator g = generatorIndex.find(registeredGenerators[r]);
+		if (g == generatorIndex.end()) {
+			return false;
+		}
+		assert(registeredParticles[r]->getStore() == &world.getParticles());
+		currentRegistrations[r * 2] = registeredParticles[r]->getIndex();
+		currentRegistrations[r * 2 + 1] = g->second;
+	}
+	return true;
+}
+
+bool ParticleSnapshotWriter::write(const char* filename, const ParticleWorld& world, bool delta) {
+	const ParticleStore& store = world.getParticles();
+	unsigned count = store.size();
+
+	// Records of a delta: the particles differing from the base in any field, and the new ones
+	changed.clear();
+	if (delta) {
+		unsigned common = count < baseCount ? count : baseCount;
+		// Compare and bring the base up to date in the same pass, on the bits of the values
+		dirty.assign(common, 0);
+		unsigned char* flags = dirty.data();
+		forEachArray(store, [this, common, flags](unsigned section, const auto& values) {
+			typedef typename Bits<sizeof(values[0])>::Type Word;
+			const Word* current = (const Word*)values.data();
+			Word* previous = (Word*)base[section].data();
+			for (unsigned i = 0; i < common; ++i) {
+				flags[i] |= current[i] != previous[i];
+				previous[i] = current[i];
+			}
+		});
+		hasBase = false;
+		for (unsigned i = 0; i < common; ++i) {
+			if (dirty[i]) {
+				changed.push_back(i);
+			}
+		}
+		for (unsigned i = common; i < count; ++i) {
+			changed.push_back(i);
+		}
+	}
+
+	ParticleSnapshotHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "CYPS", 4);
+	header.version = SNAPSHOT_VERSION;
+	header.flags = delta ? SNAPSHOT_DELTA : 0;
+	if (delta && currentRegistrations == registrations) {
+		header.flags |= SNAPSHOT_SAME_REGISTRATIONS;
+	}
+	header.realSize = sizeof(real);
+	header.positionSize = sizeof(position_real);
+	header.particleCount = count;
+	header.recordCount = delta ? (unsigned)changed.size() : count;
+	header.registrationCount = (unsigned)currentRegistrations.size() / 2;
+	header.stateHash = world.getStateHash();
+	header.accumulator = world.getAccumulator();
+	header.contentHash = hashContent(store, currentRegistrations, header.accumulator);
+	header.baseContentHash = delta ? baseContentHash : 0;
+	size_t total = computeLayout(header);
+
+	FILE* file = std::fopen(filename, "wb");
+	if (!file) {
+		return false;
+	}
+
+	// Single pass: header, then each section at its offset
+	size_t position = 0;
+	bool written = writeAt(file, position, 0, &header, sizeof(header));
+	if (delta) {
+		written = written && writeAt(file, position, header.sections[SNAPSHOT_INDEX], changed.data(), changed.size() * sizeof(unsigned));
+	}
+	forEachArray(store, [this, file, &position, &header, &written, delta](unsigned section, const auto& values) {
+		typedef typename std::decay<decltype(values[0])>::type Value;
+		if (!delta) {
+			written = written && writeAt(file, position, header.sections[section], values.data(), header.recordCount * sizeof(Value));
+			return;
+		}
+		scratch.resize(changed.size() * sizeof(Value));
+		Value* gathered = (Value*)scratch.data();
+		for (unsigned r = 0; r < changed.size(); ++r) {
+			gathered[r] = values[changed[r]];
+		}
+		written = written && writeAt(file, position, header.sections[section], gathered, scratch.size());
+	});
+	if (!(header.flags & SNAPSHOT_SAME_REGISTRATIONS)) {
+		written = written && writeAt(file, position, header.sections[SNAPSHOT_REGISTRATIONS],
+			currentRegistrations.data(), currentRegistrations.size() * sizeof(unsigned));
+	}
+	written = written && writeAt(file, position, total, 0, 0);
+	written = std::fclose(file) == 0 && written;
+	if (!written) {
+		return false;
+	}
+
+	lastRecordCount = header.recordCount;
+	setBase(world, header.contentHash, delta);
+	return true;
+}
+
+void ParticleSnapshotWriter::setBase(const ParticleWorld& world, unsigned long long contentHash, bool compared) {
+	// The comparison of a delta already updated the particles in common with the previous base
+	unsigned count = world.getParticles().size();
+	unsigned common = 0;
+	if (compared) {
+		common = baseCount < count ? baseCount : count;
+	}
+	forEachArray(world.getParticles(), [this, common](unsigned section, const auto& values) {
+		const unsigned char* bytes = (const unsigned char*)values.data();
+		base[section].resize(values.size() * sizeof(values[0]));
+		std::memcpy(base[section].data() + common * sizeof(values[0]), bytes + common * sizeof(values[0]),
+			(values.size() - common) * sizeof(values[0]));
+	});
+	baseCount = count;
+	registrations = currentRegistrations;
+	baseContentHash = contentHash;
+	hasBase = true;
+}
+
+bool ParticleSnapshotWriter::writeFull(const char* filename, const ParticleWorld& world, const GeneratorTable& generators) {
+	return buildRegistrations(world, generators) && write(filename, world, false);
+}
+
+bool ParticleSnapshotWriter::writeDelta(const char* filename, const ParticleWorld& world, const GeneratorTable& generators) {
+	return buildRegistrations(world, generators) && write(filename, world, hasBase);
+}
\ No newline at end of file
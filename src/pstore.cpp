@@ -0,0 +1,436 @@
+#include <assert.h>
+#include <cstring>
+#include "cyclone/pstore.h"
+
+using namespace cyclone;
+
+namespace {
+	// Direct mapped cache of real_pow(damping, duration) for one integration call. Particles usually share
+	// a handful of damping values, so the power is computed a few times per call instead of once per particle.
+	// Values are compared bit for bit, so the factors are exactly the ones the formula gives
+	class DampingCache {
+		enum { BITS = 4, SIZE = 1 << BITS };
+
+		real duration;
+		unsigned long long keys[SIZE];
+		real factors[SIZE];
+		bool used[SIZE];
+
+	public:
+		DampingCache(real duration) : duration(duration) {
+			for (unsigned i = 0; i < SIZE; ++i) {
+				used[i] = false;
+			}
+		}
+
+		real getFactor(real damping) {
+			unsigned long long key = 0;
+			std::memcpy(&key, &damping, sizeof(real));
+			unsigned slot = ((unsigned)(key ^ (key >> 32)) * 2654435761u) >> (32 - BITS);
+
+			if (!used[slot] || keys[slot] != key) {
+				keys[slot] = key;
+				factors[slot] = real_pow(damping, duration);
+				used[slot] = true;
+			}
+			return factors[slot];
+		}
+	};
+
+	// Damping factor computed by the caller, for a single particle
+	class FixedDamping {
+		real factor;
+
+	public:
+		FixedDamping(real factor) : factor(factor) {}
+
+		real getFactor(real) const { return factor; }
+	};
+
+	// Append the 32 bit words of a value, low word first whatever the byte order of the machine. Inline so
+	// the one a precision leaves unused does not warn
+	inline unsigned* appendWords(unsigned* words, float value) {
+		std::memcpy(words, &value, sizeof(value));
+		return words + 1;
+	}
+
+	inline unsigned* appendWords(unsigned* words, double value) {
+		unsigned long long bits;
+		std::memcpy(&bits, &value, sizeof(value));
+		words[0] = (unsigned)bits;
+		words[1] = (unsigned)(bits >> 32);
+		return words + 2;
+	}
+
+	// Keys of the particle hash, one per word
+	const unsigned HASH_KEYS[16] = {
+		0x85ebca6bu, 0xc2b2ae35u, 0x27d4eb2fu, 0x165667b1u, 0x9e3779b1u, 0xd3a2646cu, 0xfd7046c5u, 0xb55a4f09u,
+		0x7feb352du, 0x846ca68bu, 0x68e31da4u, 0xb5297a4du, 0x1b873593u, 0xcc9e2d51u, 0xe6546b64u, 0x3c6ef372u
+	};
+
+	// Hash contribution of a particle: the sum of the products of its words plus their key, taken two by two.
+	// It is not linear, so changes of different particles do not cancel out in the sum of the contributions,
+	// and a change of any one word always changes it unless the other word of the pair plus its key is zero
+	unsigned long long hashParticle(position_real px, position_real py, position_real pz,
+		real vx, real vy, real vz, real motion, unsigned char awake)
+	{
+		enum { WORDS = (3 * sizeof(position_real) + 4 * sizeof(real)) / 4 + 1, PAIRS = (WORDS + 1) / 2 };
+		unsigned words[PAIRS * 2];
+		unsigned* w = words;
+		w = appendWords(w, px); w = appendWords(w, py); w = appendWords(w, pz);
+		w = appendWords(w, vx); w = appendWords(w, vy); w = appendWords(w, vz);
+		w = appendWords(w, motion);
+		*w++ = awake;
+		if (w != words + PAIRS * 2) {
+			*w = 0;
+		}
+
+		unsigned long long hash = 0;
+		for (unsigned p = 0; p < PAIRS; ++p) {
+			hash += (unsigned long long)(words[2 * p] + HASH_KEYS[2 * p]) * (words[2 * p + 1] + HASH_KEYS[2 * p + 1]);
+		}
+		return hash;
+	}
+}
+
+ParticleStore::ParticleStore() : stateHashing(false), stateHash(0) {
+}
+
+void ParticleStore::reserve(unsigned capacity) {
+	positionX.reserve(capacity); positionY.reserve(capacity); positionZ.reserve(capacity);
+	velocityX.reserve(capacity); velocityY.reserve(capacity); velocityZ.reserve(capacity);
+	accelerationX.reserve(capacity); accelerationY.reserve(capacity); accelerationZ.reserve(capacity);
+	forceX.reserve(capacity); forceY.reserve(capacity); forceZ.reserve(capacity);
+	inverseMass.reserve(capacity);
+	mass.reserve(capacity);
+	damping.reserve(capacity);
+	motion.reserve(capacity);
+	awake.reserve(capacity);
+	canSleep.reserve(capacity);
+	handles.reserve(capacity);
+	if (stateHashing) {
+		stateHashes.reserve(capacity);
+	}
+}
+
+Particle* ParticleStore::createParticle() {
+	Particle* particle;
+	if (!freeHandles.empty()) {
+		particle = freeHandles.back();
+		freeHandles.pop_back();
+	}
+	else {
+		handlePool.push_back(Particle());
+		particle = &handlePool.back();
+	}
+
+	particle->store = this;
+	particle->index = size();
+	handles.push_back(particle);
+
+	// Same defaults as a standalone particle
+	positionX.push_back(0); positionY.push_back(0); positionZ.push_back(0);
+	velocityX.push_back(0); velocityY.push_back(0); velocityZ.push_back(0);
+	accelerationX.push_back(0); accelerationY.push_back(0); accelerationZ.push_back(0);
+	forceX.push_back(0); forceY.push_back(0); forceZ.push_back(0);
+	inverseMass.push_back(1);
+	mass.push_back(1);
+	damping.push_back(1);
+	motion.push_back(sleepEpsilon * 2);
+	awake.push_back(1);
+	canSleep.push_back(0);
+
+	if (stateHashing) {
+		stateHashes.push_back(0);
+		updateParticleHash(particle->index);
+	}
+
+	return particle;
+}
+
+void ParticleStore::destroyParticle(Particle* particle) {
+	assert(particle->store == this);
+
+	// Move the last particle into the freed slot
+	unsigned slot = particle->index;
+	unsigned last = size() - 1;
+	if (stateHashing) {
+		stateHash.fetch_sub(stateHashes[slot], std::memory_order_relaxed);
+		stateHashes[slot] = stateHashes[last];
+		stateHashes.pop_back();
+	}
+	if (slot != last) {
+		positionX[slot] = positionX[last]; positionY[slot] = positionY[last]; positionZ[slot] = positionZ[last];
+		velocityX[slot] = velocityX[last]; velocityY[slot] = velocityY[last]; velocityZ[slot] = velocityZ[last];
+		accelerationX[slot] = accelerationX[last]; accelerationY[slot] = accelerationY[last]; accelerationZ[slot] = accelerationZ[last];
+		forceX[slot] = forceX[last]; forceY[slot] = forceY[last]; forceZ[slot] = forceZ[last];
+		inverseMass[slot] = inverseMass[last];
+		mass[slot] = mass[last];
+		damping[slot] = damping[last];
+		motion[slot] = motion[last];
+		awake[slot] = awake[last];
+		canSleep[slot] = canSleep[last];
+
+		handles[slot] = handles[last];
+		handles[slot]->index = slot;
+	}
+
+	positionX.pop_back(); positionY.pop_back(); positionZ.pop_back();
+	velocityX.pop_back(); velocityY.pop_back(); velocityZ.pop_back();
+	accelerationX.pop_back(); accelerationY.pop_back(); accelerationZ.pop_back();
+	forceX.pop_back(); forceY.pop_back(); forceZ.pop_back();
+	inverseMass.pop_back();
+	mass.pop_back();
+	damping.pop_back();
+	motion.pop_back();
+	awake.pop_back();
+	canSleep.pop_back();
+	handles.pop_back();
+
+	particle->store = 0;
+	freeHandles.push_back(particle);
+}
+
+void ParticleStore::clear() {
+	positionX.clear(); positionY.clear(); positionZ.clear();
+	velocityX.clear(); velocityY.clear(); velocityZ.clear();
+	accelerationX.clear(); accelerationY.clear(); accelerationZ.clear();
+	forceX.clear(); forceY.clear(); forceZ.clear();
+	inverseMass.clear();
+	mass.clear();
+	damping.clear();
+	motion.clear();
+	awake.clear();
+	canSleep.clear();
+	stateHashes.clear();
+	stateHash.store(0, std::memory_order_relaxed);
+
+	for (unsigned i = 0; i < handles.size(); ++i) {
+		handles[i]->store = 0;
+		freeHandles.push_back(handles[i]);
+	}
+	handles.clear();
+}
+
+unsigned long long ParticleStore::getStateHash() const {
+	if (stateHashing) {
+		return stateHash.load(std::memory_order_relaxed);
+	}
+
+	unsigned long long hash = 0;
+	for (unsigned i = 0; i < size(); ++i) {
+		hash += hashParticle(positionX[i], positionY[i], positionZ[i], velocityX[i], velocityY[i], velocityZ[i], motion[i], awake[i]);
+	}
+	return hash;
+}
+
+void ParticleStore::setStateHashing(bool stateHashing) {
+	if (stateHashing == ParticleStore::stateHashing) {
+		return;
+	}
+
+	ParticleStore::stateHashing = stateHashing;
+	stateHash.store(0, std::memory_order_relaxed);
+	if (stateHashing) {
+		stateHashes.assign(size(), 0);
+		rehashState();
+	}
+	else {
+		std::vector<unsigned long long>().swap(stateHashes);
+	}
+}
+
+void ParticleStore::updateParticleHash(unsigned i) {
+	unsigned long long hash = hashParticle(positionX[i], positionY[i], positionZ[i], velocityX[i], velocityY[i], velocityZ[i], motion[i], awake[i]);
+	stateHash.fetch_add(hash - stateHashes[i], std::memory_order_relaxed);
+	stateHashes[i] = hash;
+}
+
+void ParticleStore::rehashState() {
+	if (stateHashing) {
+		stateHash.fetch_add(rehashRange(0, size()), std::memory_order_relaxed);
+	}
+}
+
+unsigned long long ParticleStore::rehashRange(unsigned begin, unsigned end) {
+	const position_real* px = positionX.data(); const position_real* py = positionY.data(); const position_real* pz = positionZ.data();
+	const real* vx = velocityX.data(); const real* vy = velocityY.data(); const real* vz = velocityZ.data();
+	const real* mot = motion.data();
+	const unsigned char* awk = awake.data();
+	unsigned long long* hashes = stateHashes.data();
+
+	// Every particle, so the loop has no branch and vectorizes. The ones that did not change add nothing
+	unsigned long long change = 0;
+	for (unsigned i = begin; i < end; ++i) {
+		unsigned long long hash = hashParticle(px[i], py[i], pz[i], vx[i], vy[i], vz[i], mot[i], awk[i]);
+		change += hash - hashes[i];
+		hashes[i] = hash;
+	}
+	return change;
+}
+
+unsigned ParticleStore::getAwakeCount() const {
+	unsigned count = 0;
+	for (unsigned i = 0; i < awake.size(); ++i) {
+		count += awake[i];
+	}
+	return count;
+}
+
+void ParticleStore::integrate(unsigned index, real duration) {
+	integrate(index, duration, real_pow(damping[index], duration), real_pow(((real)0.5), duration));
+}
+
+void ParticleStore::integrate(unsigned index, real duration, real dampingFactor, real sleepBias) {
+	FixedDamping drag(dampingFactor);
+	integrateExplicit<false>(index, index + 1, duration, sleepBias, drag);
+}
+
+void ParticleStore::integrateAll(real duration) {
+	integrateRange(0, size(), duration);
+}
+
+void ParticleStore::integrateRange(unsigned begin, unsigned end, real duration) {
+	DampingCache drag(duration);
+	integrateExplicit<false>(begin, end, duration, real_pow(((real)0.5), duration), drag);
+}
+
+void ParticleStore::integrateSymplecticRange(unsigned begin, unsigned end, real duration) {
+	DampingCache drag(duration);
+	integrateExplicit<true>(begin, end, duration, real_pow(((real)0.5), duration), drag);
+}
+
+void ParticleStore::updateSleep(unsigned i, real bias) {
+	real currentMotion = velocityX[i] * velocityX[i] + velocityY[i] * velocityY[i] + velocityZ[i] * velocityZ[i];
+	motion[i] = bias * motion[i] + (1 - bias) * currentMotion;
+
+	if (motion[i] < sleepEpsilon) {
+		awake[i] = 0;
+		velocityX[i] = 0;
+		velocityY[i] = 0;
+		velocityZ[i] = 0;
+	}
+	else if (motion[i] > 10 * sleepEpsilon) {
+		motion[i] = 10 * sleepEpsilon;
+	}
+}
+
+template<bool Symplectic, class Drag>
+void ParticleStore::integrateExplicit(unsigned begin, unsigned end, real duration, real bias, Drag& drag) {
+	assert(duration > 0.0);
+	assert(end <= size());
+
+	position_real* px = positionX.data(); position_real* py = positionY.data(); position_real* pz = positionZ.data();
+	real* vx = velocityX.data(); real* vy = velocityY.data(); real* vz = velocityZ.data();
+	const real* ax = accelerationX.data(); const real* ay = accelerationY.data(); const real* az = accelerationZ.data();
+	real* fx = forceX.data(); real* fy = forceY.data(); real* fz = forceZ.data();
+	const real* im = inverseMass.data();
+	const real* dmp = damping.data();
+	const unsigned char* awk = awake.data();
+	const unsigned char* slp = canSleep.data();
+	unsigned long long hashChange = 0;
+
+	for (unsigned block = begin; block < end; block += HASH_BLOCK) {
+		unsigned blockEnd = end - block > HASH_BLOCK ? block + HASH_BLOCK : end;
+		for (unsigned i = block; i < blockEnd; ++i) {
+			// Sleeping particles do not move
+			if (!awk[i]) {
+				continue;
+			}
+
+			// Update linear position, explicit Euler moves with the velocity at the start of the step
+			if (!Symplectic) {
+				px[i] += vx[i] * duration;
+				py[i] += vy[i] * duration;
+				pz[i] += vz[i] * duration;
+			}
+
+			// Acceleration from the force
+			real rax = ax[i] + fx[i] * im[i];
+			real ray = ay[i] + fy[i] * im[i];
+			real raz = az[i] + fz[i] * im[i];
+
+			// Update velocity from linear acceleration
+			vx[i] += rax * duration;
+			vy[i] += ray * duration;
+			vz[i] += raz * duration;
+
+			// Drag
+			real factor = drag.getFactor(dmp[i]);
+			vx[i] *= factor;
+			vy[i] *= factor;
+			vz[i] *= factor;
+
+			// Symplectic Euler moves with the new velocity
+			if (Symplectic) {
+				px[i] += vx[i] * duration;
+				py[i] += vy[i] * duration;
+				pz[i] += vz[i] * duration;
+			}
+
+			// Clear the forces
+			fx[i] = 0;
+			fy[i] = 0;
+			fz[i] = 0;
+
+			// Update the kinetic energy average and put the particle to sleep if it is at rest
+			if (slp[i]) {
+				updateSleep(i, bias);
+			}
+		}
+
+		// Hash the block while it is still in the cache
+		if (stateHashing) {
+			hashChange += rehashRange(block, blockEnd);
+		}
+	}
+	if (stateHashing) {
+		stateHash.fetch_add(hashChange, std::memory_order_relaxed);
+	}
+}
+
+void ParticleStore::completeStepRange(unsigned begin, unsigned end, real duration, const unsigned char* stepped) {
+	assert(duration > 0.0);
+	assert(end <= size());
+
+	real bias = real_pow(((real)0.5), duration);
+	DampingCache dampingCache(duration);
+	unsigned long long hashChange = 0;
+
+	for (unsigned block = begin; block < end; block += HASH_BLOCK) {
+		unsigned blockEnd = end - block > HASH_BLOCK ? block + HASH_BLOCK : end;
+		for (unsigned i = block; i < blockEnd; ++i) {
+			if (!stepped[i]) {
+				continue;
+			}
+
+			real drag = dampingCache.getFactor(damping[i]);
+			velocityX[i] *= drag;
+			velocityY[i] *= drag;
+			velocityZ[i] *= drag;
+
+			clearAccumulator(i);
+
+			if (canSleep[i]) {
+				updateSleep(i, bias);
+			}
+		}
+
+		// Hash the block while it is still in the cache
+		if (stateHashing) {
+			hashChange += rehashRange(block, blockEnd);
+		}
+	}
+	if (stateHashing) {
+		stateHash.fetch_add(hashChange, std::memory_order_relaxed);
+	}
+}
+
+void ParticleStore::clearAccumulators() {
+	unsigned count = size();
+	for (unsigned i = 0; i < count; ++i) {
+		forceX[i] = 0;
+		forceY[i] = 0;
+		forceZ[i] = 0;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,452 @@
+#include <assert.h>
+#include <cmath>
+#include "cyclone/preplay.h"
+#include "cyclone/profile.h"
+#include "cyclone/pworld.h"
+
+using namespace cyclone;
+
+namespace {
+	// Entries of stepAwake
+	enum StepState {
+		STEP_ASLEEP, // Asleep at the start of the step, not moving
+		STEP_AWAKE,  // Awake at the start of the step, moved by it
+		STEP_WOKEN   // Woken by a force evaluation of the step, its force held in the external forces
+	};
+}
+
+ParticleWorld::ParticleWorld(real fixedStep, unsigned maxSubsteps, unsigned maxContacts, unsigned iterations) :
+	resolver(iterations), contacts(maxContacts), calculateIterations(iterations == 0),
+	fixedStep(fixedStep), maxSubsteps(maxSubsteps), accumulator(0), jobs(0), integrator(INTEGRATOR_EULER),
+	recorder(0), query(0), queryDirty(false)
+{
+	assert(fixedStep > 0);
+	assert(maxSubsteps > 0);
+}
+
+Particle* ParticleWorld::createParticle() {
+	queryDirty = true;
+	return particles.createParticle();
+}
+
+void ParticleWorld::destroyParticle(Particle* particle) {
+	registry.removeAllFor(particle);
+	for (SpringNetworks::iterator n = springNetworks.begin(); n != springNetworks.end(); ++n) {
+		(*n)->removeAllFor(particle);
+	}
+	particles.destroyParticle(particle);
+	queryDirty = true;
+}
+
+void ParticleWorld::setFixedStep(real fixedStep) {
+	assert(fixedStep > 0);
+	ParticleWorld::fixedStep = fixedStep;
+}
+
+void ParticleWorld::setMaxSubsteps(unsigned maxSubsteps) {
+	assert(maxSubsteps > 0);
+	ParticleWorld::maxSubsteps = maxSubsteps;
+}
+
+void ParticleWorld::setIntegrator(Integrator integrator) {
+	assert(springNetworks.empty() || integrator == INTEGRATOR_SYMPLECTIC_EULER);
+	ParticleWorld::integrator = integrator;
+}
+
+void ParticleWorld::setQuery(ParticleQuery* query) {
+	assert(!query || query->getStore() == &particles);
+	ParticleWorld::query = query;
+	queryDirty = true;
+}
+
+void ParticleWorld::markParticlesChanged() {
+	particles.rehashState();
+	if (query) {
+		CYCLONE_PROFILE_SCOPE(PROFILE_QUERY);
+		query->update();
+	}
+	queryDirty = false;
+}
+
+void ParticleWorld::setMaxContacts(unsigned maxContacts) {
+	contacts.resize(maxContacts);
+}
+
+unsigned ParticleWorld::generateContacts() {
+	unsigned limit = (unsigned)contacts.size();
+	ParticleContact* nextContact = contacts.data();
+
+	for (ContactGenerators::iterator g = contactGenerators.begin(); g != contactGenerators.end(); ++g) {
+		unsigned used = (*g)->addContact(nextContact, limit);
+		limit -= used;
+		nextContact += used;
+
+		// We run out of contacts, the remaining ones are missed
+		if (limit <= 0) {
+			break;
+		}
+	}
+
+	// Return the number of contacts used
+	return (unsigned)contacts.size() - limit;
+}
+
+unsigned ParticleWorld::resolveContacts(real duration) {
+	if (contactGenerators.empty()) {
+		return 0;
+	}
+
+	unsigned usedContacts;
+	{
+		CYCLONE_PROFILE_SCOPE(PROFILE_CONTACT_GENERATION);
+		usedContacts = generateContacts();
+	}
+
+	if (usedContacts) {
+		CYCLONE_PROFILE_SCOPE(PROFILE_CONTACT_RESOLUTION);
+		if (calculateIterations) {
+			resolver.setIterations(usedContacts * 2);
+		}
+		resolver.resolveContacts(contacts.data(), usedContacts, duration);
+	}
+	return usedContacts;
+}
+
+ParticleForceRegistry::Handle ParticleWorld::addTransientForce(Particle* particle, ParticleForceGenerator* fg) {
+	ParticleForceRegistry::Handle handle = registry.add(particle, fg);
+	transientRegistrations.push_back(handle);
+	return handle;
+}
+
+void ParticleWorld::startFrame() {
+	// Registrations of destroyed particles are already gone, remove leaves them alone
+	for (unsigned i = 0; i < transientRegistrations.size(); ++i) {
+		registry.remove(transientRegistrations[i]);
+	}
+	transientRegistrations.clear();
+	frameArena.reset();
+
+	particles.clearAccumulators();
+}
+
+unsigned ParticleWorld::runPhysics(real duration) {
+	CYCLONE_PROFILE_SCOPE(PROFILE_FRAME);
+
+	accumulator += duration;
+
+	unsigned steps = 0;
+	while (accumulator >= fixedStep && steps < maxSubsteps) {
+		step(fixedStep);
+		accumulator -= fixedStep;
+		++steps;
+	}
+
+	// Drop the time we could not simulate, so a slow frame does not snowball into the next ones
+	if (accumulator >= fixedStep) {
+		accumulator -= fixedStep * std::floor(accumulator / fixedStep);
+	}
+
+	// One rebuild per frame rather than per step, building the grid is the costly part of the query
+	if (query && steps > 0) {
+		CYCLONE_PROFILE_SCOPE(PROFILE_QUERY);
+		query->update();
+		queryDirty = false;
+	}
+
+	return steps;
+}
+
+unsigned long long ParticleWorld::getStateHash() const {
+	unsigned long long particleHash = particles.getStateHash();
+	unsigned count = particles.size();
+	StateHash hash;
+	hash.add(&particleHash, sizeof(particleHash));
+	hash.add(&count, sizeof(count));
+	hash.add(&accumulator, sizeof(accumulator));
+	return hash.get();
+}
+
+void ParticleWorld::updateForces(real duration) {
+	if (jobs) {
+		registry.updateForces(duration, *jobs);
+	}
+	else {
+		registry.updateForces(duration);
+	}
+
+	if (!forceFields.empty()) {
+		updateForceFields(duration);
+	}
+
+	if (!areaForces.empty()) {
+		updateAreaForces(duration);
+	}
+
+	for (SpringNetworks::iterator n = springNetworks.begin(); n != springNetworks.end(); ++n) {
+		(*n)->updateForces(duration);
+	}
+}
+
+void ParticleWorld::updateForceFields(real duration) {
+	CYCLONE_PROFILE_SCOPE(PROFILE_FORCES);
+
+	// Each range gets the fields in the same order, so the parallel pass matches the serial one
+	ParticleStore* store = &particles;
+	JobSystem::RangeJob job = [this, store, duration](unsigned begin, unsigned end) {
+		for (ForceFields::iterator f = forceFields.begin(); f != forceFields.end(); ++f) {
+			(*f)->updateForces(store, begin, end, duration);
+		}
+	};
+	if (jobs) {
+		jobs->parallelFor(particles.size(), 4096, job);
+	}
+	else {
+		job(0, particles.size());
+	}
+}
+
+void ParticleWorld::updateAreaForces(real duration) {
+	// Particles created, destroyed or restored since the last update would be missing or out of range
+	if (query && (queryDirty || query->size() != particles.size())) {
+		CYCLONE_PROFILE_SCOPE(PROFILE_QUERY);
+		query->update();
+		queryDirty = false;
+	}
+
+	CYCLONE_PROFILE_SCOPE(PROFILE_FORCES);
+	for (AreaForces::iterator a = areaForces.begin(); a != areaForces.end(); ++a) {
+		(*a)->apply(&particles, query, duration, jobs);
+	}
+}
+
+void ParticleWorld::integrateParticles(const JobSystem::RangeJob& job) {
+	CYCLONE_PROFILE_SCOPE(PROFILE_INTEGRATION);
+
+	// Integration is independent per particle, so the ranges split over the threads without any locking
+	if (jobs) {
+		jobs->parallelFor(particles.size(), 4096, job);
+	}
+	else {
+		job(0, particles.size());
+	}
+}
+
+void ParticleWorld::step(real duration) {
+	CYCLONE_PROFILE_SCOPE(PROFILE_STEP);
+
+	// The networks may have been added after the integrator was selected
+	assert(springNetworks.empty() || integrator == INTEGRATOR_SYMPLECTIC_EULER);
+
+	switch (integrator) {
+	case INTEGRATOR_VERLET:
+		stepVerlet(duration);
+		break;
+	case INTEGRATOR_RK4:
+		stepRungeKutta(duration);
+		break;
+	default:
+		// First apply the force generators, forces are only read across particles so they can be
+		// updated in parallel too
+		updateForces(duration);
+
+		// Then integrate the objects (this also clears the accumulators)
+		if (integrator == INTEGRATOR_SYMPLECTIC_EULER) {
+			integrateParticles([this, duration](unsigned begin, unsigned end) {
+				particles.integrateSymplecticRange(begin, end, duration);
+			});
+		}
+		else {
+			integrateParticles([this, duration](unsigned begin, unsigned end) {
+				particles.integrateRange(begin, end, duration);
+			});
+		}
+		break;
+	}
+
+	// Finally process the contacts
+	unsigned usedContacts = resolveContacts(duration);
+	CYCLONE_PROFILE_COUNTERS(particles.size(), particles.getAwakeCount(), registry.size(), usedContacts);
+	(void)usedContacts;
+
+	// Explosions and other timed effects move on to the next step
+	for (AreaForces::iterator a = areaForces.begin(); a != areaForces.end(); ++a) {
+		(*a)->advance(duration);
+	}
+
+	if (recorder) {
+		recorder->record(particles, duration);
+	}
+}
+
+void ParticleWorld::saveExternalForces() {
+	unsigned count = particles.size();
+	externalForceX.assign(particles.forceX.begin(), particles.forceX.end());
+	externalForceY.assign(particles.forceY.begin(), particles.forceY.end());
+	externalForceZ.assign(particles.forceZ.begin(), particles.forceZ.end());
+	stepAwake.assign(particles.awake.begin(), particles.awake.end());
+	startVelocityX.resize(count); startVelocityY.resize(count); startVelocityZ.resize(count);
+	derivativeX.resize(count); derivativeY.resize(count); derivativeZ.resize(count);
+}
+
+bool ParticleWorld::isStepping(unsigned i) {
+	if (stepAwake[i] == STEP_AWAKE) {
+		return true;
+	}
+
+	// Later evaluations add to the force, the one of the evaluation that woke the particle is kept
+	if (stepAwake[i] == STEP_ASLEEP && particles.awake[i]) {
+		stepAwake[i] = STEP_WOKEN;
+		externalForceX[i] = particles.forceX[i];
+		externalForceY[i] = particles.forceY[i];
+		externalForceZ[i] = particles.forceZ[i];
+	}
+	return false;
+}
+
+void ParticleWorld::completeStepRange(unsigned begin, unsigned end, real duration) {
+	for (unsigned i = begin; i < end; ++i) {
+		if (stepAwake[i] == STEP_WOKEN) {
+			particles.forceX[i] = externalForceX[i];
+			particles.forceY[i] = externalForceY[i];
+			particles.forceZ[i] = externalForceZ[i];
+			stepAwake[i] = STEP_ASLEEP;
+		}
+	}
+
+	// Damping and sleep only for the particles that moved, the woken ones start at the next step
+	particles.completeStepRange(begin, end, duration, stepAwake.data());
+}
+
+void ParticleWorld::stepVerlet(real duration) {
+	ParticleStore& p = particles;
+
+	// Forces added since startFrame apply to both evaluations
+	saveExternalForces();
+	updateForces(duration);
+
+	// Move with the acceleration at the start of the step, derivative holds that acceleration
+	real halfSquare = duration * duration * ((real)0.5);
+	integrateParticles([this, &p, duration, halfSquare](unsigned begin, unsigned end) {
+		for (unsigned i = begin; i < end; ++i) {
+			if (!isStepping(i)) {
+				continue;
+			}
+
+			derivativeX[i] = p.accelerationX[i] + p.forceX[i] * p.inverseMass[i];
+			derivativeY[i] = p.accelerationY[i] + p.forceY[i] * p.inverseMass[i];
+			derivativeZ[i] = p.accelerationZ[i] + p.forceZ[i] * p.inverseMass[i];
+
+			p.positionX[i] += p.velocityX[i] * duration + derivativeX[i] * halfSquare;
+			p.positionY[i] += p.velocityY[i] * duration + derivativeY[i] * halfSquare;
+			p.positionZ[i] += p.velocityZ[i] * duration + derivativeZ[i] * halfSquare;
+
+			// Predicted velocity, seen by the velocity dependent generators at the end of the step
+			startVelocityX[i] = p.velocityX[i];
+			startVelocityY[i] = p.velocityY[i];
+			startVelocityZ[i] = p.velocityZ[i];
+			p.velocityX[i] += derivativeX[i] * duration;
+			p.velocityY[i] += derivativeY[i] * duration;
+			p.velocityZ[i] += derivativeZ[i] * duration;
+
+			p.forceX[i] = externalForceX[i];
+			p.forceY[i] = externalForceY[i];
+			p.forceZ[i] = externalForceZ[i];
+		}
+	});
+
+	// Forces at the end of the step
+	updateForces(duration);
+
+	// The velocity changes by the average of the two accelerations
+	real halfDuration = duration * ((real)0.5);
+	integrateParticles([this, &p, duration, halfDuration](unsigned begin, unsigned end) {
+		for (unsigned i = begin; i < end; ++i) {
+			if (!isStepping(i)) {
+				continue;
+			}
+
+			real ax = p.accelerationX[i] + p.forceX[i] * p.inverseMass[i];
+			real ay = p.accelerationY[i] + p.forceY[i] * p.inverseMass[i];
+			real az = p.accelerationZ[i] + p.forceZ[i] * p.inverseMass[i];
+			p.velocityX[i] = startVelocityX[i] + (derivativeX[i] + ax) * halfDuration;
+			p.velocityY[i] = startVelocityY[i] + (derivativeY[i] + ay) * halfDuration;
+			p.velocityZ[i] = startVelocityZ[i] + (derivativeZ[i] + az) * halfDuration;
+		}
+
+		completeStepRange(begin, end, duration);
+	});
+}
+
+void ParticleWorld::stepRungeKutta(real duration) {
+	ParticleStore& p = particles;
+	unsigned count = p.size();
+
+	saveExternalForces();
+	startPositionX.assign(p.positionX.begin(), p.positionX.end());
+	startPositionY.assign(p.positionY.begin(), p.positionY.end());
+	startPositionZ.assign(p.positionZ.begin(), p.positionZ.end());
+	sumVelocityX.assign(count, 0); sumVelocityY.assign(count, 0); sumVelocityZ.assign(count, 0);
+	sumAccelerationX.assign(count, 0); sumAccelerationY.assign(count, 0); sumAccelerationZ.assign(count, 0);
+	for (unsigned i = 0; i < count; ++i) {
+		startVelocityX[i] = p.velocityX[i];
+		startVelocityY[i] = p.velocityY[i];
+		startVelocityZ[i] = p.velocityZ[i];
+	}
+
+	// Weight of each evaluation in the final sum, and offset of the next evaluation point
+	static const real weights[4] = { 1, 2, 2, 1 };
+	static const real offsets[3] = { ((real)0.5), ((real)0.5), 1 };
+
+	for (unsigned stage = 0; stage < 4; ++stage) {
+		updateForces(duration);
+
+		real weight = weights[stage];
+		bool last = stage == 3;
+		real offset = last ? duration / 6 : offsets[stage] * duration;
+		integrateParticles([this, &p, weight, last, offset, duration](unsigned begin, unsigned end) {
+			for (unsigned i = begin; i < end; ++i) {
+				if (!isStepping(i)) {
+					continue;
+				}
+
+				// Derivatives at the evaluation point: the velocity and the acceleration
+				sumVelocityX[i] += p.velocityX[i] * weight;
+				sumVelocityY[i] += p.velocityY[i] * weight;
+				sumVelocityZ[i] += p.velocityZ[i] * weight;
+				real ax = p.accelerationX[i] + p.forceX[i] * p.inverseMass[i];
+				real ay = p.accelerationY[i] + p.forceY[i] * p.inverseMass[i];
+				real az = p.accelerationZ[i] + p.forceZ[i] * p.inverseMass[i];
+				sumAccelerationX[i] += ax * weight;
+				sumAccelerationY[i] += ay * weight;
+				sumAccelerationZ[i] += az * weight;
+
+				if (last) {
+					// Final state from the weighted sum of the four derivatives
+					p.positionX[i] = startPositionX[i] + sumVelocityX[i] * offset;
+					p.positionY[i] = startPositionY[i] + sumVelocityY[i] * offset;
+					p.positionZ[i] = startPositionZ[i] + sumVelocityZ[i] * offset;
+					p.velocityX[i] = startVelocityX[i] + sumAccelerationX[i] * offset;
+					p.velocityY[i] = startVelocityY[i] + sumAccelerationY[i] * offset;
+					p.velocityZ[i] = startVelocityZ[i] + sumAccelerationZ[i] * offset;
+				}
+				else {
+					// Next evaluation point, moved from the start along the current derivatives
+					p.positionX[i] = startPositionX[i] + p.velocityX[i] * offset;
+					p.positionY[i] = startPositionY[i] + p.velocityY[i] * offset;
+					p.positionZ[i] = startPositionZ[i] + p.velocityZ[i] * offset;
+					p.velocityX[i] = startVelocityX[i] + ax * offset;
+					p.velocityY[i] = startVelocityY[i] + ay * offset;
+					p.velocityZ[i] = startVelocityZ[i] + az * offset;
+
+					p.forceX[i] = externalForceX[i];
+					p.forceY[i] = externalForceY[i];
+					p.forceZ[i] = externalForceZ[i];
+				}
+			}
+
+			if (last) {
+				completeStepRange(begin, end, duration);
+			}
+		});
+	}
+}
\ No newline at end of file